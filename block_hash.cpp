@@ -0,0 +1,382 @@
+#include "block_hash.h"
+#include "call_graph.h"
+#include "disassembler.h"
+#include "inline_params.h"
+#include "parallel.h"
+
+#include <err.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <functional>
+
+
+namespace {
+
+	// index file, little endian:
+	// "OMMB" version modules routines buckets strings
+	// routines: module, address, blocks, minhash[minhash_size]
+	// buckets: key (64 bits), routine.  sorted.
+	// names: offset into strings, per module
+	// strings: nul terminated
+	constexpr const uint32_t kVersion = 1;
+	constexpr const size_t kHeaderSize = 24;
+	constexpr const size_t kRoutineSize = 12 + minhash_size * 4;
+	constexpr const size_t kBucketSize = 12;
+
+	// smaller routines (rts, jmp xxxx) match everything.
+	constexpr const unsigned kMinInstructions = 4;
+
+	uint64_t mix(uint64_t x) {
+		x ^= x >> 30;
+		x *= UINT64_C(0xbf58476d1ce4e5b9);
+		x ^= x >> 27;
+		x *= UINT64_C(0x94d049bb133111eb);
+		x ^= x >> 31;
+		return x;
+	}
+
+	struct fnv {
+		uint64_t value = UINT64_C(0xcbf29ce484222325);
+		void operator()(uint8_t c) {
+			value ^= c;
+			value *= UINT64_C(0x100000001b3);
+		}
+	};
+
+	uint64_t band_key(unsigned band, const uint32_t *rows) {
+		uint64_t key = mix(band + 1);
+		for (unsigned i = 0; i < minhash_rows; ++i) key = mix(key ^ rows[i]);
+		return key;
+	}
+
+	void put16(std::vector<uint8_t> &v, uint32_t x) {
+		v.push_back(x);
+		v.push_back(x >> 8);
+	}
+
+	void put32(std::vector<uint8_t> &v, uint32_t x) {
+		put16(v, x);
+		put16(v, x >> 16);
+	}
+
+	uint64_t u64(const le_view &v, size_t offset) {
+		return v.u32(offset) | ((uint64_t)v.u32(offset + 4) << 32);
+	}
+}
+
+
+std::vector<block_hash> block_hashes(const module &m) {
+
+	const auto &h = m.h;
+	const auto &params = inline_params::standard();
+	const auto &space = m.address_space;
+
+	auto relocatable = [&](uint32_t x){
+		return x >= space.first && x < space.second;
+	};
+
+	// pointer bytes from the immediate table.
+	std::vector<uint8_t> immediate;
+	if (m.end_code != m.end) {
+		le_cursor c(m.end_code + 1, m.end_immediate);
+		for (uint16_t x; c.read(x); ) {
+			immediate.push_back(x);
+			immediate.push_back(x >> 8);
+		}
+		std::sort(immediate.begin(), immediate.end());
+	}
+
+	auto is_label = [&](uint32_t pc){
+		return std::binary_search(m.labels.begin(), m.labels.end(), pc, std::greater<unsigned>());
+	};
+
+	std::vector<block_hash> rv;
+
+	auto scan = [&](uint32_t begin, uint32_t end) {
+		block_hash b = { begin, 0, 0 };
+		fnv f;
+
+		auto finish = [&](uint32_t next){
+			if (b.instructions) {
+				b.hash = f.value;
+				rv.push_back(b);
+			}
+			b = { next, 0, 0 };
+			f = fnv();
+		};
+
+		for (uint32_t pc = begin; pc < end; ) {
+			if (pc != b.address && is_label(pc)) finish(pc);
+
+			const uint8_t *p = m.begin + (pc - h.org);
+			uint8_t op = *p;
+			unsigned size = disassembler::operand_size(op, false, false);
+			if (pc + 1 + size > end) break;
+
+			uint32_t arg = 0;
+			for (unsigned i = 0; i < size; ++i) arg |= p[1 + i] << (8 * i);
+
+			unsigned mode = disassembler::operand_mode(op) & 0xf000;
+			bool masked = false;
+			switch (mode) {
+				case mImmediate:
+					masked = std::binary_search(immediate.begin(), immediate.end(), (uint8_t)arg);
+					break;
+				case mAbsolute:
+				case mAbsoluteI:
+				case mAbsoluteIL:
+					masked = relocatable(arg);
+					break;
+				case mAbsoluteLong:
+					masked = arg < 0x10000 && relocatable(arg);
+					break;
+			}
+			// pea is an immediate, not an address, but often is one.
+			if (op == 0xf4) masked = relocatable(arg);
+
+			f(op);
+			if (masked) f(0xff);
+			else for (unsigned i = 0; i < size; ++i) f(p[1 + i]);
+
+			pc += 1 + size;
+			++b.instructions;
+
+			// inline parameters are data.  Only the length counts.
+			if (op == 0x20) {
+				unsigned n = params.length(arg, p + 1 + size, m.end);
+				f(n);
+				pc += n;
+			}
+
+			if (disassembler::branchlike(op)) finish(pc);
+		}
+		finish(end);
+	};
+
+	scan(h.org, h.org + (m.end_code - m.begin));
+	for (const auto &r : m.code_regions) scan(r.begin, r.end);
+
+	std::sort(rv.begin(), rv.end(), [](const block_hash &a, const block_hash &b){
+		return a.address < b.address;
+	});
+	return rv;
+}
+
+
+std::vector<routine_hash> routine_hashes(const module &m) {
+
+	const auto &h = m.h;
+	auto blocks = block_hashes(m);
+
+	call_graph g;
+	g.build(m);
+
+	std::vector<uint32_t> entries;
+	for (const auto &r : g.routines()) {
+		if (!r.external) entries.push_back(r.address);
+	}
+	std::sort(entries.begin(), entries.end());
+
+	// a routine runs to the next entry or the end of its region.
+	std::vector<std::pair<uint32_t, uint32_t>> regions;
+	regions.emplace_back(h.org, h.org + (m.end_code - m.begin));
+	for (const auto &r : m.code_regions) regions.emplace_back(r.begin, r.end);
+
+	std::vector<routine_hash> rv;
+	for (size_t i = 0; i < entries.size(); ++i) {
+		uint32_t begin = entries[i];
+		uint32_t end = i + 1 < entries.size() ? entries[i + 1] : UINT32_MAX;
+		for (const auto &r : regions) {
+			if (begin >= r.first && begin < r.second) end = std::min(end, r.second);
+		}
+
+		auto iter = std::lower_bound(blocks.begin(), blocks.end(), begin, [](const block_hash &b, uint32_t x){
+			return b.address < x;
+		});
+
+		routine_hash rh;
+		rh.address = begin;
+		rh.blocks = 0;
+		rh.minhash.fill(UINT32_MAX);
+		unsigned instructions = 0;
+
+		for ( ; iter != blocks.end() && iter->address < end; ++iter) {
+			++rh.blocks;
+			instructions += iter->instructions;
+			for (unsigned k = 0; k < minhash_size; ++k) {
+				uint32_t x = mix(iter->hash ^ mix(k + 1)) >> 32;
+				rh.minhash[k] = std::min(rh.minhash[k], x);
+			}
+		}
+		if (instructions >= kMinInstructions) rv.push_back(rh);
+	}
+	return rv;
+}
+
+
+unsigned block_corpus::add(const std::string &name, const header &h, const uint8_t *data) {
+	entry e;
+	e.name = name;
+	e.h = h;
+	e.data = data;
+	_modules.emplace_back(std::move(e));
+	return _modules.size() - 1;
+}
+
+
+void block_corpus::build(unsigned flags, unsigned threads) {
+
+	parallel_for(_modules.size(), threads, [this, flags](size_t i){
+		auto &e = _modules[i];
+		module m;
+
+		analyze(m, e.h, e.data, flags);
+		e.routines = routine_hashes(m);
+	});
+}
+
+
+bool block_corpus::write(const std::string &path) const {
+
+	std::vector<uint8_t> routines;
+	std::vector<std::pair<uint64_t, uint32_t>> buckets;
+	std::vector<uint8_t> names;
+	std::vector<uint8_t> strings;
+
+	uint32_t count = 0;
+	for (size_t i = 0; i < _modules.size(); ++i) {
+		const auto &e = _modules[i];
+
+		put32(names, strings.size());
+		strings.insert(strings.end(), e.name.begin(), e.name.end());
+		strings.push_back(0);
+
+		for (const auto &r : e.routines) {
+			put32(routines, i);
+			put32(routines, r.address);
+			put32(routines, r.blocks);
+			for (auto x : r.minhash) put32(routines, x);
+
+			for (unsigned b = 0; b < minhash_bands; ++b)
+				buckets.emplace_back(band_key(b, r.minhash.data() + b * minhash_rows), count);
+			++count;
+		}
+	}
+	std::sort(buckets.begin(), buckets.end());
+
+	std::vector<uint8_t> tmp = { 'O', 'M', 'M', 'B' };
+	put32(tmp, kVersion);
+	put32(tmp, _modules.size());
+	put32(tmp, count);
+	put32(tmp, buckets.size());
+	put32(tmp, strings.size());
+	tmp.insert(tmp.end(), routines.begin(), routines.end());
+	for (const auto &b : buckets) {
+		put32(tmp, b.first);
+		put32(tmp, b.first >> 32);
+		put32(tmp, b.second);
+	}
+	tmp.insert(tmp.end(), names.begin(), names.end());
+	tmp.insert(tmp.end(), strings.begin(), strings.end());
+
+	FILE *f = fopen(path.c_str(), "wb");
+	if (!f) {
+		warn("%s", path.c_str());
+		return false;
+	}
+	bool ok = fwrite(tmp.data(), 1, tmp.size(), f) == tmp.size();
+	if (fclose(f) != 0) ok = false;
+	if (!ok) warn("%s", path.c_str());
+	return ok;
+}
+
+
+bool block_index::open(const uint8_t *data, size_t size) {
+
+	le_view v(data, size);
+	if (!v.has(kHeaderSize) || memcmp(data, "OMMB", 4) || v.u32(4) != kVersion) return false;
+
+	uint64_t modules = v.u32(8);
+	uint64_t routines = v.u32(12);
+	uint64_t buckets = v.u32(16);
+	uint64_t strings = v.u32(20);
+
+	size_t offset = kHeaderSize;
+	uint64_t total = offset + routines * kRoutineSize + buckets * kBucketSize + modules * 4 + strings;
+	if (total != size) return false;
+
+	_routines = v.sub(offset, routines * kRoutineSize);
+	offset += routines * kRoutineSize;
+	_buckets = v.sub(offset, buckets * kBucketSize);
+	offset += buckets * kBucketSize;
+	_names = v.sub(offset, modules * 4);
+	offset += modules * 4;
+	_strings = v.sub(offset);
+
+	// the only thing not checked on use.
+	if (strings && _strings.u8(strings - 1)) return false;
+	for (unsigned i = 0; i < modules; ++i) {
+		if (_names.u32(i * 4) >= strings) return false;
+	}
+	for (unsigned i = 0; i < routines; ++i) {
+		if (_routines.u32(i * kRoutineSize) >= modules) return false;
+	}
+	for (unsigned i = 0; i < buckets; ++i) {
+		if (_buckets.u32(i * kBucketSize + 8) >= routines) return false;
+	}
+
+	_module_count = modules;
+	_routine_count = routines;
+	_bucket_count = buckets;
+	return true;
+}
+
+
+std::string block_index::module_name(unsigned i) const {
+	return std::string((const char *)_strings.begin() + _names.u32(i * 4));
+}
+
+
+std::vector<block_index::match> block_index::query(const routine_hash &r, float threshold) const {
+
+	// candidates share at least one band.
+	std::vector<uint32_t> candidates;
+	for (unsigned b = 0; b < minhash_bands; ++b) {
+		uint64_t key = band_key(b, r.minhash.data() + b * minhash_rows);
+
+		size_t lo = 0, hi = _bucket_count;
+		while (lo < hi) {
+			size_t mid = (lo + hi) / 2;
+			if (u64(_buckets, mid * kBucketSize) < key) lo = mid + 1;
+			else hi = mid;
+		}
+		for ( ; lo < _bucket_count && u64(_buckets, lo * kBucketSize) == key; ++lo)
+			candidates.push_back(_buckets.u32(lo * kBucketSize + 8));
+	}
+	std::sort(candidates.begin(), candidates.end());
+	candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+
+	std::vector<match> rv;
+	for (auto i : candidates) {
+		size_t offset = i * kRoutineSize;
+		unsigned same = 0;
+		for (unsigned k = 0; k < minhash_size; ++k)
+			same += _routines.u32(offset + 12 + k * 4) == r.minhash[k];
+
+		float similarity = (float)same / minhash_size;
+		if (similarity < threshold) continue;
+
+		match m;
+		m.module = _routines.u32(offset);
+		m.address = _routines.u32(offset + 4);
+		m.blocks = _routines.u32(offset + 8);
+		m.similarity = similarity;
+		rv.push_back(m);
+	}
+
+	std::stable_sort(rv.begin(), rv.end(), [](const match &a, const match &b){
+		return a.similarity > b.similarity;
+	});
+	return rv;
+}
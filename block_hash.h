@@ -0,0 +1,105 @@
+#ifndef __block_hash_h__
+#define __block_hash_h__
+
+#include "omm.h"
+#include "le_view.h"
+
+#include <stdint.h>
+#include <array>
+#include <string>
+#include <utility>
+#include <vector>
+
+// fuzzy matching of routines across a corpus of modules.
+// Basic blocks are hashed from the decoded instructions with
+// relocatable operands (absolute addresses inside the module and
+// operands listed in the immediate table) masked out, so the same
+// code at a different org hashes the same.  Each routine is then
+// reduced to a MinHash of its block hashes and bucketed by LSH bands.
+
+enum {
+	minhash_size = 32,
+	minhash_bands = 8,
+	minhash_rows = minhash_size / minhash_bands,
+};
+
+struct block_hash {
+	uint32_t address;
+	unsigned instructions;
+	uint64_t hash;
+};
+
+struct routine_hash {
+	uint32_t address;
+	unsigned blocks;
+	std::array<uint32_t, minhash_size> minhash;
+};
+
+// every basic block in the code section and code regions, by address.
+std::vector<block_hash> block_hashes(const module &m);
+
+// routines (org, jsr targets, jump table entries) with enough code to
+// be worth matching.
+std::vector<routine_hash> routine_hashes(const module &m);
+
+
+// builds an index file.
+class block_corpus {
+
+public:
+
+	// data points to the header and must outlive the corpus.
+	unsigned add(const std::string &name, const header &h, const uint8_t *data);
+
+	// analyze and hash every module.
+	void build(unsigned flags = 0, unsigned threads = 0);
+
+	bool write(const std::string &path) const;
+
+private:
+
+	struct entry {
+		std::string name;
+		header h;
+		const uint8_t *data;
+		std::vector<routine_hash> routines;
+	};
+
+	std::vector<entry> _modules;
+};
+
+
+// a (mapped) index file.  Nothing is loaded; queries binary search
+// the bucket table in place.
+class block_index {
+
+public:
+
+	struct match {
+		unsigned module;
+		uint32_t address;
+		unsigned blocks;
+		// estimated jaccard similarity of the block sets.
+		float similarity;
+	};
+
+	bool open(const uint8_t *data, size_t size);
+
+	// best first.
+	std::vector<match> query(const routine_hash &r, float threshold = 0.5) const;
+
+	unsigned modules() const { return _module_count; }
+	std::string module_name(unsigned i) const;
+
+private:
+
+	le_view _routines;
+	le_view _buckets;
+	le_view _names;
+	le_view _strings;
+	unsigned _module_count = 0;
+	unsigned _routine_count = 0;
+	unsigned _bucket_count = 0;
+};
+
+#endif
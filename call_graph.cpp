@@ -0,0 +1,451 @@
+#include "call_graph.h"
+#include "disassembler.h"
+#include "inline_params.h"
+
+#include <algorithm>
+
+
+namespace {
+
+	// pushes (and pulls) with a fixed size.
+	int stack_effect(uint8_t op) {
+		switch(op) {
+			case 0x08: // php
+			case 0x48: // pha
+			case 0x4b: // phk
+			case 0x5a: // phy
+			case 0x8b: // phb
+			case 0xda: // phx
+				return 1;
+			case 0x0b: // phd
+			case 0x62: // per
+			case 0xd4: // pei
+			case 0xf4: // pea
+				return 2;
+			case 0x28: // plp
+			case 0x68: // pla
+			case 0x7a: // ply
+			case 0xab: // plb
+			case 0xfa: // plx
+				return -1;
+			case 0x2b: // pld
+				return -2;
+		}
+		return 0;
+	}
+
+	int call_cost(unsigned kind) {
+		switch(kind) {
+			case call_graph::kind_jsr: return 2;
+			case call_graph::kind_jsl: return 3;
+		}
+		return 0;
+	}
+
+	// a loop that keeps pushing.
+	constexpr const int kMaxDepth = 256;
+}
+
+
+int call_graph::find(uint32_t address) const {
+	auto iter = _index.find(address);
+	if (iter == _index.end()) return -1;
+	return iter->second;
+}
+
+unsigned call_graph::add(uint32_t address, bool external) {
+	auto iter = _index.find(address);
+	if (iter != _index.end()) return iter->second;
+
+	routine r;
+	r.address = address;
+	r.external = external;
+	_routines.push_back(r);
+	_index.emplace(address, _routines.size() - 1);
+	return _routines.size() - 1;
+}
+
+
+void call_graph::build(const module &m) {
+
+	_routines.clear();
+	_index.clear();
+	_components.clear();
+
+	const auto &h = m.h;
+
+	add(h.org, false);
+	for (const auto &t : m.jump_tables) {
+		le_cursor c(m.begin + (t.first - h.org), m.begin + (t.second - h.org));
+		for (uint16_t x; c.read(x); ) {
+			if (x >= m.address_space.first && x < m.address_space.second) add(x, false);
+		}
+	}
+
+	// walk adds callees as it goes.
+	std::vector<std::vector<call>> calls;
+	for (unsigned i = 0; i < _routines.size(); ++i) {
+		calls.emplace_back();
+		if (!_routines[i].external) walk(m, i, calls.back());
+	}
+
+	_call_index.clear();
+	_calls.clear();
+	for (const auto &v : calls) {
+		_call_index.push_back(_calls.size());
+		_calls.insert(_calls.end(), v.begin(), v.end());
+	}
+	_call_index.push_back(_calls.size());
+
+	// callers, by counting.
+	std::vector<unsigned> count(_routines.size() + 1);
+	for (const auto &c : _calls) ++count[c.callee + 1];
+	for (size_t i = 1; i < count.size(); ++i) count[i] += count[i - 1];
+	_caller_index = count;
+	_callers.resize(_calls.size());
+	for (unsigned i = 0; i < _routines.size(); ++i) {
+		for (unsigned j = _call_index[i]; j < _call_index[i + 1]; ++j)
+			_callers[count[_calls[j].callee]++] = i;
+	}
+
+	strongly_connected();
+	depths();
+}
+
+
+// every path from the entry until it returns or leaves the code.
+void call_graph::walk(const module &m, unsigned index, std::vector<call> &calls) {
+
+	const auto &h = m.h;
+	const auto &params = inline_params::standard();
+	const uint32_t end_code = h.org + (m.end_code - m.begin);
+
+	auto in_code = [&](uint32_t pc){
+		if (pc >= h.org && pc < end_code) return true;
+		for (const auto &r : m.code_regions) {
+			if (pc >= r.begin && pc < r.end) return true;
+		}
+		return false;
+	};
+
+	auto in_module = [&](uint32_t pc){
+		return pc >= m.address_space.first && pc < m.address_space.second;
+	};
+
+	auto add_call = [&](uint32_t target, unsigned kind, int depth){
+		unsigned callee = add(target, !in_module(target) || !in_code(target));
+		for (auto &c : calls) {
+			if (c.callee == callee && c.kind == kind) {
+				c.depth = std::max(c.depth, depth);
+				return;
+			}
+		}
+		calls.push_back(call{ callee, kind, depth });
+	};
+
+	// deepest stack seen at each address.
+	std::unordered_map<uint32_t, int> seen;
+	std::vector<std::pair<uint32_t, int>> work;
+	int push = 0;
+	bool unbalanced = false;
+
+	work.emplace_back(_routines[index].address, 0);
+	while (!work.empty()) {
+		uint32_t pc = work.back().first;
+		int depth = work.back().second;
+		work.pop_back();
+
+		uint8_t previous = 0;
+		while (in_code(pc)) {
+			auto iter = seen.find(pc);
+			if (iter != seen.end() && iter->second >= depth) break;
+			seen[pc] = depth;
+
+			if (depth > kMaxDepth) {
+				unbalanced = true;
+				break;
+			}
+
+			const uint8_t *p = m.begin + (pc - h.org);
+			uint8_t op = *p;
+			unsigned size = disassembler::operand_size(op, false, false);
+			if (m.end - p < 1 + size) break;
+
+			uint32_t arg = 0;
+			for (unsigned i = 0; i < size; ++i) arg |= p[1 + i] << (8 * i);
+			uint32_t next = pc + 1 + size;
+
+			depth += stack_effect(op);
+			push = std::max(push, depth);
+
+			bool done = false;
+			switch(op) {
+				case 0x20: // jsr
+					add_call(arg, kind_jsr, depth);
+					next += params.length(arg, p + 1 + size, m.end);
+					break;
+
+				case 0x22: // jsl
+					add_call(arg, kind_jsl, depth);
+					break;
+
+				case 0x4c: // jmp
+					if (in_code(arg)) next = arg;
+					else {
+						add_call(arg, kind_jmp, depth);
+						done = true;
+					}
+					break;
+
+				case 0x5c: // jml
+					add_call(arg, kind_jmp, depth);
+					done = true;
+					break;
+
+				case 0x7c: // jmp (abs,x)
+				case 0xfc: // jsr (abs,x)
+					for (const auto &t : m.jump_tables) {
+						if (t.first != arg) continue;
+						le_cursor c(m.begin + (t.first - h.org), m.begin + (t.second - h.org));
+						for (uint16_t x; c.read(x); ) {
+							if (!in_module(x)) continue;
+							if (op == 0xfc) add_call(x, kind_jsr, depth);
+							else work.emplace_back(x, depth);
+						}
+					}
+					done = op == 0x7c;
+					break;
+
+				case 0x40: // rti
+				case 0x60: // rts
+				case 0x6b: // rtl
+					// pha/pha/rts dispatch is fine.
+					if (depth != 0 && !(op == 0x60 && depth == 2 && previous == 0x48))
+						unbalanced = true;
+					done = true;
+					break;
+
+				case 0x00: // brk
+				case 0x6c: // jmp (abs)
+				case 0xdb: // stp
+				case 0xdc: // jml [abs]
+					done = true;
+					break;
+
+				case 0x80: // bra
+				case 0x82: // brl
+					next = disassembler::relative_address(pc, size, arg);
+					break;
+
+				default:
+					// conditional branches
+					if ((op & 0x1f) == 0x10)
+						work.emplace_back(disassembler::relative_address(pc, size, arg), depth);
+					break;
+			}
+			if (done) break;
+			previous = op;
+			pc = next;
+		}
+	}
+
+	auto &r = _routines[index];
+	r.push = push;
+	r.unbalanced = unbalanced;
+}
+
+
+// tarjan, iteratively.  components come out callees first.
+void call_graph::strongly_connected() {
+
+	const unsigned n = _routines.size();
+	const unsigned none = ~0u;
+
+	std::vector<unsigned> order(n, none);
+	std::vector<unsigned> low(n, 0);
+	std::vector<bool> on_stack(n, false);
+	std::vector<unsigned> stack;
+	// routine, next call to look at.
+	std::vector<std::pair<unsigned, unsigned>> frames;
+	unsigned counter = 0;
+
+	for (unsigned root = 0; root < n; ++root) {
+		if (order[root] != none) continue;
+
+		frames.emplace_back(root, _call_index[root]);
+		order[root] = low[root] = counter++;
+		stack.push_back(root);
+		on_stack[root] = true;
+
+		while (!frames.empty()) {
+			unsigned v = frames.back().first;
+			unsigned &i = frames.back().second;
+
+			if (i < _call_index[v + 1]) {
+				unsigned w = _calls[i++].callee;
+				if (order[w] == none) {
+					frames.emplace_back(w, _call_index[w]);
+					order[w] = low[w] = counter++;
+					stack.push_back(w);
+					on_stack[w] = true;
+				} else if (on_stack[w]) {
+					low[v] = std::min(low[v], order[w]);
+				}
+				continue;
+			}
+
+			frames.pop_back();
+			if (!frames.empty()) {
+				unsigned u = frames.back().first;
+				low[u] = std::min(low[u], low[v]);
+			}
+
+			if (low[v] != order[v]) continue;
+
+			std::vector<unsigned> component;
+			for (;;) {
+				unsigned w = stack.back();
+				stack.pop_back();
+				on_stack[w] = false;
+				component.push_back(w);
+				if (w == v) break;
+			}
+			_components.emplace_back(std::move(component));
+		}
+	}
+
+	for (const auto &c : _components) {
+		bool recursive = c.size() > 1;
+		if (!recursive) {
+			auto range = calls(c.front());
+			recursive = std::any_of(range.first, range.second, [&](const call &x){
+				return x.callee == c.front();
+			});
+		}
+		for (auto i : c) _routines[i].recursive = recursive;
+	}
+}
+
+
+void call_graph::depths() {
+
+	for (const auto &c : _components) {
+		for (auto i : c) {
+			auto &r = _routines[i];
+
+			if (r.recursive) {
+				r.depth = -1;
+				continue;
+			}
+
+			r.depth = r.push;
+			auto range = calls(i);
+			for (auto iter = range.first; iter != range.second; ++iter) {
+				int d = _routines[iter->callee].depth;
+				if (d < 0) {
+					r.depth = -1;
+					break;
+				}
+				r.depth = std::max(r.depth, iter->depth + call_cost(iter->kind) + d);
+			}
+		}
+	}
+}
+
+
+void call_graph::write_text(FILE *f, const namer &name) const {
+
+	for (unsigned i = 0; i < _routines.size(); ++i) {
+		const auto &r = _routines[i];
+
+		fprintf(f, "$%04x  %-16s", r.address, name(r.address).c_str());
+		if (r.external) fputs("  external", f);
+		else {
+			if (r.depth < 0) fputs("  depth recursive", f);
+			else fprintf(f, "  depth %-3d", r.depth);
+			fprintf(f, "  push %d", r.push);
+			if (r.unbalanced) fputs("  unbalanced", f);
+		}
+		fputc('\n', f);
+
+		auto range = calls(i);
+		for (auto iter = range.first; iter != range.second; ++iter) {
+			static const char *kinds[] = { "jsr", "jsl", "jmp" };
+			fprintf(f, "        %s %s", kinds[iter->kind], name(_routines[iter->callee].address).c_str());
+			if (iter->depth) fprintf(f, " (stack %+d)", iter->depth);
+			fputc('\n', f);
+		}
+	}
+}
+
+
+void call_graph::write_dot(FILE *f, const namer &name) const {
+
+	fputs("digraph calls {\n", f);
+	fputs("\tnode [shape=box];\n", f);
+
+	for (unsigned i = 0; i < _routines.size(); ++i) {
+		const auto &r = _routines[i];
+		std::string label = name(r.address);
+
+		if (r.external) {
+			fprintf(f, "\tn%u [label=\"%s\", style=dashed];\n", i, label.c_str());
+			continue;
+		}
+		if (r.depth < 0) label += "\\ndepth recursive";
+		else label += "\\ndepth " + std::to_string(r.depth);
+		fprintf(f, "\tn%u [label=\"%s\"%s];\n", i, label.c_str(), r.recursive ? ", color=red" : "");
+	}
+
+	for (unsigned i = 0; i < _routines.size(); ++i) {
+		auto range = calls(i);
+		for (auto iter = range.first; iter != range.second; ++iter) {
+			fprintf(f, "\tn%u -> n%u%s;\n", i, iter->callee,
+				iter->kind == kind_jmp ? " [style=dashed]" : "");
+		}
+	}
+	fputs("}\n", f);
+}
+
+
+void call_graph::write_json(FILE *f, const namer &name) const {
+
+	auto quote = [](const std::string &s){
+		std::string rv = "\"";
+		for (char c : s) {
+			if (c == '"' || c == '\\') rv.push_back('\\');
+			rv.push_back(c);
+		}
+		rv.push_back('"');
+		return rv;
+	};
+
+	static const char *kinds[] = { "jsr", "jsl", "jmp" };
+
+	fputs("{\n  \"routines\": [\n", f);
+	for (unsigned i = 0; i < _routines.size(); ++i) {
+		const auto &r = _routines[i];
+
+		fprintf(f, "    { \"address\": %u, \"name\": %s, \"external\": %s",
+			r.address, quote(name(r.address)).c_str(), r.external ? "true" : "false");
+		if (!r.external) {
+			fprintf(f, ", \"push\": %d, \"depth\": %s, \"recursive\": %s, \"unbalanced\": %s",
+				r.push, r.depth < 0 ? "null" : std::to_string(r.depth).c_str(),
+				r.recursive ? "true" : "false", r.unbalanced ? "true" : "false");
+		}
+		fprintf(f, " }%s\n", i + 1 < _routines.size() ? "," : "");
+	}
+	fputs("  ],\n  \"calls\": [\n", f);
+
+	bool first = true;
+	for (unsigned i = 0; i < _routines.size(); ++i) {
+		auto range = calls(i);
+		for (auto iter = range.first; iter != range.second; ++iter) {
+			if (!first) fputs(",\n", f);
+			first = false;
+			fprintf(f, "    { \"from\": %u, \"to\": %u, \"kind\": \"%s\", \"depth\": %d }",
+				_routines[i].address, _routines[iter->callee].address, kinds[iter->kind], iter->depth);
+		}
+	}
+	fputs(first ? "  ]\n}\n" : "\n  ]\n}\n", f);
+}
@@ -0,0 +1,86 @@
+#ifndef __call_graph_h__
+#define __call_graph_h__
+
+#include "omm.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// routines (org, jsr/jsl targets and jump table entries) and the calls
+// between them, with a worst case stack depth for each.
+// Depths are bytes pushed below the routine's own return address.
+// Calls outside the module (rom, mli) cost the return address only.
+
+class call_graph {
+
+public:
+
+	enum { kind_jsr, kind_jsl, kind_jmp };
+
+	struct routine {
+		uint32_t address = 0;
+		// outside the module's code (rom, mli, data) so not walked.
+		bool external = false;
+		// a path returns with something still pushed (or pulled).
+		bool unbalanced = false;
+		bool recursive = false;
+		// most bytes pushed by the routine itself.
+		int push = 0;
+		// worst case including calls.  -1 if recursive.
+		int depth = 0;
+	};
+
+	struct call {
+		unsigned callee;
+		unsigned kind;
+		// bytes pushed at the call.
+		int depth;
+	};
+
+	typedef std::function<std::string(uint32_t)> namer;
+
+	void build(const module &m);
+
+	const std::vector<routine> &routines() const { return _routines; }
+
+	// -1 if not found.
+	int find(uint32_t address) const;
+
+	std::pair<const call *, const call *> calls(unsigned i) const {
+		return std::make_pair(_calls.data() + _call_index[i], _calls.data() + _call_index[i + 1]);
+	}
+
+	std::pair<const unsigned *, const unsigned *> callers(unsigned i) const {
+		return std::make_pair(_callers.data() + _caller_index[i], _callers.data() + _caller_index[i + 1]);
+	}
+
+	void write_text(FILE *f, const namer &name) const;
+	void write_dot(FILE *f, const namer &name) const;
+	void write_json(FILE *f, const namer &name) const;
+
+private:
+
+	unsigned add(uint32_t address, bool external);
+	void walk(const module &m, unsigned index, std::vector<call> &calls);
+	void strongly_connected();
+	void depths();
+
+	std::vector<routine> _routines;
+	std::unordered_map<uint32_t, unsigned> _index;
+
+	// adjacency arrays, indexed by routine.
+	std::vector<unsigned> _call_index;
+	std::vector<call> _calls;
+	std::vector<unsigned> _caller_index;
+	std::vector<unsigned> _callers;
+
+	// strongly connected components, callees first.
+	std::vector<std::vector<unsigned>> _components;
+};
+
+#endif
@@ -0,0 +1,147 @@
+#include "classifier.h"
+#include "disassembler.h"
+#include "parallel.h"
+
+#include <algorithm>
+
+
+// 65816 (or wdc 65c02) only.  Unlikely to appear in an OMM module.
+static bool native_only(uint8_t op) {
+
+	switch(op & 0x0f) {
+		case 0x03:
+		case 0x07:
+		case 0x0b:
+		case 0x0f:
+			return true;
+	}
+
+	switch(op) {
+		case 0x02: // cop
+		case 0x22: // jsl
+		case 0x42: // wdm
+		case 0x44: // mvp
+		case 0x54: // mvn
+		case 0x5c: // jml
+		case 0x62: // per
+		case 0x82: // brl
+		case 0xc2: // rep
+		case 0xd4: // pei
+		case 0xdc: // jml []
+		case 0xe2: // sep
+		case 0xf4: // pea
+			return true;
+		default:
+			return false;
+	}
+}
+
+
+bool classifier::known(uint32_t address) const {
+	return std::binary_search(_known.begin(), _known.end(), address);
+}
+
+
+void classifier::score(region &r) const {
+
+	uint32_t pc = r.begin;
+	int score = r.weight;
+	unsigned count = 0;
+	bool done = false;
+
+	while (pc < r.end) {
+		uint8_t op = _data[pc - _org];
+		unsigned mode = disassembler::operand_mode(op);
+		unsigned size = disassembler::operand_size(op, false, false);
+		uint32_t next = pc + 1 + size;
+
+		// runs into the next region / brk.
+		if (next > r.end || op == 0x00) {
+			score -= 10;
+			break;
+		}
+		if (native_only(op)) score -= 5;
+
+		uint32_t arg = 0;
+		for (unsigned i = 0; i < size; ++i)
+			arg |= _data[pc + 1 + i - _org] << (i * 8);
+
+		switch(mode & 0xf000) {
+			case mRelative: {
+				uint32_t target = next + arg;
+				if (size == 1 && (arg & 0x80)) target += 0xff00;
+				target &= 0xffff;
+
+				if (target >= r.begin && target < r.end) score += 2;
+				else if (in_module(target)) score += 1;
+				else score -= 6;
+				break;
+			}
+
+			case mAbsolute:
+			case mAbsoluteI:
+				if (op == 0x20 || op == 0x4c) {
+					if (known(arg)) score += 4;
+					else if (in_module(arg)) score += 2;
+					else score -= 2;
+				}
+				else if (known(arg) || in_module(arg)) score += 1;
+				break;
+		}
+
+		++count;
+		++score;
+		pc = next;
+		if (disassembler::terminal(op)) {
+			done = true;
+			break;
+		}
+	}
+
+	if (done) score += 5;
+	else score -= 5;
+
+	r.score = score;
+	r.code = done && count > 1 && score >= threshold;
+	if (r.code) r.end = pc;
+}
+
+
+std::vector<classifier::region>
+classifier::classify(uint32_t begin, uint32_t end, unsigned threads) {
+
+	std::vector<std::pair<uint32_t, int>> starts;
+	std::vector<region> regions;
+
+	std::sort(_known.begin(), _known.end());
+
+	for (const auto &x : _references) {
+		if (x.first >= begin && x.first < end) starts.push_back(x);
+	}
+	// strongest reference first, then drop the rest.
+	std::sort(starts.begin(), starts.end(),
+		[](const std::pair<uint32_t, int> &a, const std::pair<uint32_t, int> &b){
+			return a.first < b.first || (a.first == b.first && a.second > b.second);
+		}
+	);
+	starts.erase(std::unique(starts.begin(), starts.end(),
+		[](const std::pair<uint32_t, int> &a, const std::pair<uint32_t, int> &b){
+			return a.first == b.first;
+		}
+	), starts.end());
+
+	// each region runs until the next reference.
+	regions.resize(starts.size());
+	for (unsigned i = 0; i < starts.size(); ++i) {
+		regions[i].begin = starts[i].first;
+		regions[i].end = i + 1 < starts.size() ? starts[i + 1].first : end;
+		regions[i].weight = starts[i].second;
+	}
+
+	// regions are independent so score them in parallel.
+	parallel_for(regions.size(), threads, [&](size_t i){
+		score(regions[i]);
+	});
+
+	return regions;
+}
@@ -0,0 +1,65 @@
+#ifndef __classifier_h__
+#define __classifier_h__
+
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+// speculative code vs data classifier.
+// each candidate region (starting at a referenced address) is decoded
+// as 6502 code and scored.  Regions that look enough like code
+// are returned as [begin, end) address ranges.
+
+class classifier {
+
+public:
+
+	struct region {
+		uint32_t begin = 0;
+		uint32_t end = 0;
+		int score = 0;
+		int weight = 0;
+		bool code = false;
+	};
+
+	// data/size is the full module image, loaded at org.
+	classifier(const uint8_t *data, uint32_t size, uint32_t org) :
+		_data(data), _size(size), _org(org)
+	{}
+
+	// known entry points (rom, mli, etc)
+	void add_known(uint32_t address) { _known.push_back(address); }
+
+	// references from the code section or immediate table.  jsr, jmp
+	// and branch targets weigh more than pointers, which are usually
+	// strings.
+	static constexpr const int pointer = 1;
+	static constexpr const int call = 4;
+
+	void add_reference(uint32_t address, int weight = pointer) {
+		_references.emplace_back(address, weight);
+	}
+
+	// score everything referenced in [begin, end).
+	std::vector<region> classify(uint32_t begin, uint32_t end, unsigned threads = 0);
+
+	static constexpr const int threshold = 12;
+
+private:
+
+	void score(region &r) const;
+
+	bool known(uint32_t address) const;
+	bool in_module(uint32_t address) const {
+		return address >= _org && address < _org + _size;
+	}
+
+	const uint8_t *_data;
+	uint32_t _size;
+	uint32_t _org;
+
+	std::vector<uint32_t> _known;
+	std::vector<std::pair<uint32_t, int>> _references;
+};
+
+#endif
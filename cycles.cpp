@@ -0,0 +1,124 @@
+#include "cycles.h"
+
+#include <strings.h>
+
+namespace {
+
+	// low nybble is the base cycle count.
+	enum {
+		P = 0x10,  // +1 if the index crosses a page (or x16 on the 65816)
+		M = 0x20,  // +1 if m16
+		W = 0x40,  // +2 if m16 (read/modify/write)
+		X = 0x80,  // +1 if x16
+		D = 0x100, // +1 if the direct page low byte is not 0
+	};
+
+	const uint16_t mos6502[256] = {
+		7,   6,   0,   0,   0,   3,   5,   0,   3,   2,   2,   0,   0,   4,   6,   0,   // 0x
+		2,   5|P, 0,   0,   0,   4,   6,   0,   2,   4|P, 0,   0,   0,   4|P, 7,   0,   // 1x
+		6,   6,   0,   0,   3,   3,   5,   0,   4,   2,   2,   0,   4,   4,   6,   0,   // 2x
+		2,   5|P, 0,   0,   0,   4,   6,   0,   2,   4|P, 0,   0,   0,   4|P, 7,   0,   // 3x
+		6,   6,   0,   0,   0,   3,   5,   0,   3,   2,   2,   0,   3,   4,   6,   0,   // 4x
+		2,   5|P, 0,   0,   0,   4,   6,   0,   2,   4|P, 0,   0,   0,   4|P, 7,   0,   // 5x
+		6,   6,   0,   0,   0,   3,   5,   0,   4,   2,   2,   0,   5,   4,   6,   0,   // 6x
+		2,   5|P, 0,   0,   0,   4,   6,   0,   2,   4|P, 0,   0,   0,   4|P, 7,   0,   // 7x
+		0,   6,   0,   0,   3,   3,   3,   0,   2,   0,   2,   0,   4,   4,   4,   0,   // 8x
+		2,   6,   0,   0,   4,   4,   4,   0,   2,   5,   2,   0,   0,   5,   0,   0,   // 9x
+		2,   6,   2,   0,   3,   3,   3,   0,   2,   2,   2,   0,   4,   4,   4,   0,   // ax
+		2,   5|P, 0,   0,   4,   4,   4,   0,   2,   4|P, 2,   0,   4|P, 4|P, 4|P, 0,   // bx
+		2,   6,   0,   0,   3,   3,   5,   0,   2,   2,   2,   0,   4,   4,   6,   0,   // cx
+		2,   5|P, 0,   0,   0,   4,   6,   0,   2,   4|P, 0,   0,   0,   4|P, 7,   0,   // dx
+		2,   6,   0,   0,   3,   3,   5,   0,   2,   2,   2,   0,   4,   4,   6,   0,   // ex
+		2,   5|P, 0,   0,   0,   4,   6,   0,   2,   4|P, 0,   0,   0,   4|P, 7,   0,   // fx
+	};
+
+	// wdc/gte 65c02.  The rockwell bit instructions (x7, xf) decode as
+	// 65816 instructions so they're left out.
+	const uint16_t wdc65c02[256] = {
+		7,   6,   0,   0,   5,   3,   5,   0,   3,   2,   2,   0,   6,   4,   6,   0,   // 0x
+		2,   5|P, 5,   0,   5,   4,   6,   0,   2,   4|P, 2,   0,   6,   4|P, 6|P, 0,   // 1x
+		6,   6,   0,   0,   3,   3,   5,   0,   4,   2,   2,   0,   4,   4,   6,   0,   // 2x
+		2,   5|P, 5,   0,   4,   4,   6,   0,   2,   4|P, 2,   0,   4|P, 4|P, 6|P, 0,   // 3x
+		6,   6,   0,   0,   0,   3,   5,   0,   3,   2,   2,   0,   3,   4,   6,   0,   // 4x
+		2,   5|P, 5,   0,   0,   4,   6,   0,   2,   4|P, 3,   0,   0,   4|P, 6|P, 0,   // 5x
+		6,   6,   0,   0,   3,   3,   5,   0,   4,   2,   2,   0,   6,   4,   6,   0,   // 6x
+		2,   5|P, 5,   0,   4,   4,   6,   0,   2,   4|P, 4,   0,   6,   4|P, 6|P, 0,   // 7x
+		2,   6,   0,   0,   3,   3,   3,   0,   2,   2,   2,   0,   4,   4,   4,   0,   // 8x
+		2,   6,   5,   0,   4,   4,   4,   0,   2,   5,   2,   0,   4,   5,   5,   0,   // 9x
+		2,   6,   2,   0,   3,   3,   3,   0,   2,   2,   2,   0,   4,   4,   4,   0,   // ax
+		2,   5|P, 5,   0,   4,   4,   4,   0,   2,   4|P, 2,   0,   4|P, 4|P, 4|P, 0,   // bx
+		2,   6,   0,   0,   3,   3,   5,   0,   2,   2,   2,   0,   4,   4,   6,   0,   // cx
+		2,   5|P, 5,   0,   0,   4,   6,   0,   2,   4|P, 3,   0,   0,   4|P, 7,   0,   // dx
+		2,   6,   0,   0,   3,   3,   5,   0,   2,   2,   2,   0,   4,   4,   6,   0,   // ex
+		2,   5|P, 5,   0,   0,   4,   6,   0,   2,   4|P, 4,   0,   0,   4|P, 7,   0,   // fx
+	};
+
+	const uint16_t wdc65816[256] = {
+		8,     6|M|D,   8,     4|M,   5|W|D, 3|M|D, 5|W|D, 6|M|D, 3,   2|M,   2,   4, 6|W,   4|M,   6|W,   5|M, // 0x
+		2,     5|M|D|P, 5|M|D, 7|M,   5|W|D, 4|M|D, 6|W|D, 6|M|D, 2,   4|M|P, 2,   2, 6|W,   4|M|P, 7|W,   5|M, // 1x
+		6,     6|M|D,   8,     4|M,   3|M|D, 3|M|D, 5|W|D, 6|M|D, 4,   2|M,   2,   5, 4|M,   4|M,   6|W,   5|M, // 2x
+		2,     5|M|D|P, 5|M|D, 7|M,   4|M|D, 4|M|D, 6|W|D, 6|M|D, 2,   4|M|P, 2,   2, 4|M|P, 4|M|P, 7|W,   5|M, // 3x
+		7,     6|M|D,   2,     4|M,   7,     3|M|D, 5|W|D, 6|M|D, 3|M, 2|M,   2,   3, 3,     4|M,   6|W,   5|M, // 4x
+		2,     5|M|D|P, 5|M|D, 7|M,   7,     4|M|D, 6|W|D, 6|M|D, 2,   4|M|P, 3|X, 2, 4,     4|M|P, 7|W,   5|M, // 5x
+		6,     6|M|D,   6,     4|M,   3|M|D, 3|M|D, 5|W|D, 6|M|D, 4|M, 2|M,   2,   6, 5,     4|M,   6|W,   5|M, // 6x
+		2,     5|M|D|P, 5|M|D, 7|M,   4|M|D, 4|M|D, 6|W|D, 6|M|D, 2,   4|M|P, 4|X, 2, 6,     4|M|P, 7|W,   5|M, // 7x
+		2,     6|M|D,   4,     4|M,   3|X|D, 3|M|D, 3|X|D, 6|M|D, 2,   2|M,   2,   3, 4|X,   4|M,   4|X,   5|M, // 8x
+		2,     6|M|D,   5|M|D, 7|M,   4|X|D, 4|M|D, 4|X|D, 6|M|D, 2,   5|M,   2,   2, 4|M,   5|M,   5|M,   5|M, // 9x
+		2|X,   6|M|D,   2|X,   4|M,   3|X|D, 3|M|D, 3|X|D, 6|M|D, 2,   2|M,   2,   4, 4|X,   4|M,   4|X,   5|M, // ax
+		2,     5|M|D|P, 5|M|D, 7|M,   4|X|D, 4|M|D, 4|X|D, 6|M|D, 2,   4|M|P, 2,   2, 4|X|P, 4|M|P, 4|X|P, 5|M, // bx
+		2|X,   6|M|D,   3,     4|M,   3|X|D, 3|M|D, 5|W|D, 6|M|D, 2,   2|M,   2,   3, 4|X,   4|M,   6|W,   5|M, // cx
+		2,     5|M|D|P, 5|M|D, 7|M,   6|D,   4|M|D, 6|W|D, 6|M|D, 2,   4|M|P, 3|X, 3, 6,     4|M|P, 7|W,   5|M, // dx
+		2|X,   6|M|D,   3,     4|M,   3|X|D, 3|M|D, 5|W|D, 6|M|D, 2,   2|M,   2,   3, 4|X,   4|M,   6|W,   5|M, // ex
+		2,     5|M|D|P, 5|M|D, 7|M,   5,     4|M|D, 6|W|D, 6|M|D, 2,   4|M|P, 4|X, 2, 8,     4|M|P, 7|W,   5|M, // fx
+	};
+
+	bool conditional_branch(uint8_t op) {
+		return (op & 0x1f) == 0x10;
+	}
+}
+
+cycles cycle_count(unsigned cpu, uint8_t op, bool m16, bool x16, bool dl) {
+
+	cycles rv;
+	unsigned x;
+
+	switch(cpu) {
+		case cpu_6502: x = mos6502[op]; break;
+		case cpu_65c02: x = wdc65c02[op]; break;
+		case cpu_65816: x = wdc65816[op]; break;
+		default: return rv;
+	}
+
+	rv.count = x & 0x0f;
+	if (!rv.count) return rv;
+
+	if (cpu == cpu_65816) {
+		if (m16 && (x & M)) rv.count += 1;
+		if (m16 && (x & W)) rv.count += 2;
+		if (x16 && (x & X)) rv.count += 1;
+		if (dl && (x & D)) rv.count += 1;
+		// 16-bit index registers always pay the page crossing cycle.
+		if (x & P) {
+			if (x16) rv.count += 1;
+			else rv.page = true;
+		}
+	} else {
+		rv.page = x & P;
+	}
+
+	if (conditional_branch(op) || (op == 0x80 && cpu != cpu_6502)) {
+		rv.taken = rv.count + 1;
+		// only in emulation mode on the 65816.
+		rv.branch_page = cpu != cpu_65816;
+		// bra is always taken.
+		if (op == 0x80) rv.count = rv.taken;
+	}
+	return rv;
+}
+
+unsigned parse_cpu(const char *name) {
+	if (!strcasecmp(name, "6502")) return cpu_6502;
+	if (!strcasecmp(name, "65c02")) return cpu_65c02;
+	if (!strcasecmp(name, "65816")) return cpu_65816;
+	return cpu_none;
+}
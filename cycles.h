@@ -0,0 +1,32 @@
+#ifndef __cycles_h__
+#define __cycles_h__
+
+#include <stdint.h>
+
+// instruction timing.  The 65816 is timed in native mode.
+
+enum {
+	cpu_none = 0,
+	cpu_6502,
+	cpu_65c02,
+	cpu_65816,
+};
+
+struct cycles {
+	// 0 if the opcode doesn't exist on the cpu.  Branches are not taken.
+	unsigned count = 0;
+	// branches (including bra), taken and on the same page.
+	unsigned taken = 0;
+	// +1 if the index crosses a page.
+	bool page = false;
+	// +1 for a taken branch to another page.
+	bool branch_page = false;
+};
+
+// m16/x16 and dl (the direct page low byte is not 0) only apply to the 65816.
+cycles cycle_count(unsigned cpu, uint8_t op, bool m16 = false, bool x16 = false, bool dl = false);
+
+// 0 if unknown.
+unsigned parse_cpu(const char *name);
+
+#endif
@@ -0,0 +1,152 @@
+#include "daemon.h"
+
+#include <ctype.h>
+#include <err.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+
+namespace {
+
+	const size_t kMaxData = 16 * 1024 * 1024;
+
+	bool write_all(int fd, const void *data, size_t size) {
+		auto cp = (const uint8_t *)data;
+		while (size) {
+			ssize_t n = write(fd, cp, size);
+			if (n < 0) {
+				if (errno == EINTR) continue;
+				return false;
+			}
+			cp += n;
+			size -= n;
+		}
+		return true;
+	}
+
+	std::vector<std::string> split(const char *cp) {
+		std::vector<std::string> rv;
+		for(;;) {
+			while (isspace(*cp)) ++cp;
+			if (!*cp) break;
+			const char *begin = cp;
+			while (*cp && !isspace(*cp)) ++cp;
+			rv.emplace_back(begin, cp);
+		}
+		return rv;
+	}
+
+	void session(int fd, const request_handler &handler) {
+
+		FILE *in = fdopen(dup(fd), "r");
+		if (!in) return;
+
+		char *line = nullptr;
+		size_t capacity = 0;
+
+		while (getline(&line, &capacity, in) > 0) {
+			request r;
+			r.args = split(line);
+			if (r.args.empty()) continue;
+
+			std::string error;
+			bool ok = true;
+
+			if (r.args.front() == "data") {
+				char *end = nullptr;
+				size_t size = r.args.size() > 1 ? strtoul(r.args.back().c_str(), &end, 10) : 0;
+				if (r.args.size() < 2 || *end || size > kMaxData) {
+					write_all(fd, "error bad data length\n", 22);
+					break;
+				}
+				r.args.pop_back();
+				r.data.resize(size);
+				if (fread(r.data.data(), 1, size, in) != size) break;
+			}
+
+			char *buffer = nullptr;
+			size_t size = 0;
+			FILE *out = open_memstream(&buffer, &size);
+			if (!out) {
+				ok = false;
+				error = strerror(errno);
+			} else {
+				ok = handler(r, out, error);
+				fclose(out);
+			}
+
+			std::string header = ok ? "ok " + std::to_string(size) + "\n" : "error " + error + "\n";
+			bool written = write_all(fd, header.data(), header.size()) && (!ok || write_all(fd, buffer, size));
+			free(buffer);
+			if (!written) break;
+		}
+
+		free(line);
+		fclose(in);
+	}
+}
+
+
+void serve(const std::string &path, unsigned threads, const request_handler &handler) {
+
+	// a client going away shouldn't take the server with it.
+	signal(SIGPIPE, SIG_IGN);
+
+	sockaddr_un addr = {};
+	addr.sun_family = AF_UNIX;
+	if (path.size() >= sizeof(addr.sun_path))
+		errx(1, "%s: path too long", path.c_str());
+	strcpy(addr.sun_path, path.c_str());
+
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) err(1, "socket");
+
+	unlink(path.c_str());
+	if (bind(fd, (sockaddr *)&addr, sizeof(addr)) < 0) err(1, "%s", path.c_str());
+	if (listen(fd, 64) < 0) err(1, "%s", path.c_str());
+
+	if (!threads) threads = std::thread::hardware_concurrency();
+	if (!threads) threads = 1;
+
+	std::mutex mutex;
+	std::condition_variable cv;
+	std::deque<int> clients;
+
+	std::vector<std::thread> pool;
+	for (unsigned i = 0; i < threads; ++i) {
+		pool.emplace_back([&](){
+			for(;;) {
+				int client;
+				{
+					std::unique_lock<std::mutex> lock(mutex);
+					cv.wait(lock, [&](){ return !clients.empty(); });
+					client = clients.front();
+					clients.pop_front();
+				}
+				session(client, handler);
+				close(client);
+			}
+		});
+	}
+
+	for(;;) {
+		int client = accept(fd, nullptr, nullptr);
+		if (client < 0) {
+			if (errno != EINTR) warn("accept");
+			continue;
+		}
+		std::lock_guard<std::mutex> lock(mutex);
+		clients.push_back(client);
+		cv.notify_one();
+	}
+}
@@ -0,0 +1,29 @@
+#ifndef __daemon_h__
+#define __daemon_h__
+
+#include <stdint.h>
+#include <stdio.h>
+#include <functional>
+#include <string>
+#include <vector>
+
+// request/response server on a unix domain socket.  Connections are
+// handled by a thread pool and may send any number of requests:
+//
+// request:  command [argument ...] LF
+//           "data" requests end with a byte count; the bytes follow the LF.
+// response: "ok" length LF, then length bytes of output
+//           "error" message LF
+
+struct request {
+	std::vector<std::string> args;
+	std::vector<uint8_t> data;
+};
+
+// writes the reply to out.  returns false (and sets error) on failure.
+typedef std::function<bool(const request &, FILE *out, std::string &error)> request_handler;
+
+// doesn't return.
+void serve(const std::string &path, unsigned threads, const request_handler &handler);
+
+#endif
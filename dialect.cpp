@@ -0,0 +1,120 @@
+#include "dialect.h"
+#include "disassembler.h"
+
+#include <iterator>
+
+
+namespace {
+
+	const dialect dialects[] = {
+		{
+			"mpw", disassembler::mpw,
+			{ nullptr, "dc.b", "dc.w", "dc.a", "dc.l" },
+			{ "", "", "", "", "" }, "",
+			"ds.b",
+			"dcb.b", false,
+			dialect::single_quote,
+			{ { nullptr, nullptr }, { nullptr, nullptr } },
+			{ "case", "on" },
+			nullptr,
+			"proc", "endp", "record", "endr", "end",
+			"",
+		},
+		{
+			"orca", disassembler::orca,
+			{ nullptr, "dc", "dc", "dc", "dc" },
+			{ "", "i1'", "i2'", "i3'", "i4'" }, "'",
+			"ds",
+			"dc", true,
+			dialect::orca_c,
+			{ { nullptr, nullptr }, { nullptr, nullptr } },
+			{ "case", "on" },
+			nullptr,
+			"start", "end", "data", "end", nullptr,
+			"",
+		},
+		{
+			"merlin", disassembler::merlin,
+			{ nullptr, "dfb", "da", "adr", "adrl" },
+			{ "", "", "", "", "" }, "",
+			"ds",
+			"ds", false,
+			dialect::characters,
+			{ { "xc", "" }, { "xc", "" } },
+			{ nullptr, nullptr },
+			"org",
+			nullptr, nullptr, nullptr, nullptr, nullptr,
+			"",
+		},
+		{
+			"ca65", disassembler::ca65,
+			{ nullptr, ".byte", ".word", ".faraddr", ".dword" },
+			{ "", "", "", "", "" }, "",
+			".res",
+			".res", false,
+			dialect::double_quote,
+			{ { ".p816", "" }, { nullptr, nullptr } },
+			{ nullptr, nullptr },
+			".org",
+			nullptr, nullptr, nullptr, nullptr, nullptr,
+			":",
+		},
+	};
+}
+
+
+const dialect *dialect::find(const std::string &name) {
+	for (const auto &d : dialects)
+		if (name == d.name) return &d;
+	return nullptr;
+}
+
+const dialect &dialect::standard() {
+	return dialects[0];
+}
+
+
+dialect::line dialect::data(unsigned size, const std::string &expr) const {
+	if (size < 1 || size > 4) return line(std::to_string(size) + " bytes", expr);
+	if (*data_prefix[size]) return line(data_op[size], data_prefix[size] + expr + data_suffix);
+	return line(data_op[size], expr);
+}
+
+dialect::line dialect::fill(unsigned count, const std::string &expr) const {
+	if (fill_repeat) return line(fill_op, std::to_string(count) + data_prefix[1] + expr + data_suffix);
+	return line(fill_op, std::to_string(count) + "," + expr);
+}
+
+std::string dialect::item(const std::string &expr) const {
+	if (*data_prefix[1]) return data_prefix[1] + expr + data_suffix;
+	return expr;
+}
+
+std::string dialect::text(const std::string &s) const {
+	std::string tmp;
+	switch(text_style) {
+		case single_quote:
+			return "'" + s + "'";
+		case double_quote:
+			return "\"" + s + "\"";
+		case orca_c:
+			return "c'" + s + "'";
+		case characters:
+			for (char c : s) {
+				if (!tmp.empty()) tmp += ", ";
+				tmp += '\'';
+				tmp += c;
+				tmp += '\'';
+			}
+			return tmp;
+	}
+	return tmp;
+}
+
+std::vector<dialect::line> dialect::modes(bool m16, bool x16) const {
+	if (traits & disassembler::ca65_size_prefix)
+		return { line(m16 ? ".a16" : ".a8", ""), line(x16 ? ".i16" : ".i8", "") };
+	if (traits & disassembler::no_size_prefix)
+		return { line("mx", std::string("%") + (m16 ? "0" : "1") + (x16 ? "0" : "1")) };
+	return { line("longa", m16 ? "on" : "off"), line("longi", x16 ? "on" : "off") };
+}
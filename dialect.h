@@ -0,0 +1,59 @@
+#ifndef __dialect_h__
+#define __dialect_h__
+
+#include <string>
+#include <utility>
+#include <vector>
+
+// assembler syntax for a listing.  The disassembler traits cover
+// operands; the rest (data, directives, labels) is here.
+
+struct dialect {
+
+	typedef std::pair<std::string, std::string> line; // opcode, operand
+
+	const char *name;
+	unsigned traits;
+
+	// dc.b/dc.w/dc.a/dc.l equivalents, by size.
+	const char *data_op[5];
+	// orca wraps the operand: i1'...'
+	const char *data_prefix[5];
+	const char *data_suffix;
+	const char *space_op;
+	// non-zero fill: op count,value or (orca) op count<data_prefix>value.
+	const char *fill_op;
+	bool fill_repeat;
+
+	// text in a byte list.
+	enum { single_quote, double_quote, orca_c, characters } text_style;
+
+	// directives (opcode, operand).  nullptr if the assembler has no
+	// equivalent.  cpu comes before and options after the register sizes.
+	const char *cpu[2][2];
+	const char *options[2];
+	const char *org;
+	const char *proc;
+	const char *endp;
+	const char *record;
+	const char *endr;
+	const char *end;
+	const char *label_suffix;
+
+	line data(unsigned size, const std::string &expr) const;
+	// count copies of a byte.
+	line fill(unsigned count, const std::string &expr) const;
+	std::string text(const std::string &s) const;
+	// operands in a byte list (that may include text).
+	std::string item(const std::string &expr) const;
+
+	// register size directives.
+	std::vector<line> modes(bool m16, bool x16) const;
+
+	std::string label(const std::string &s) const { return s + label_suffix; }
+
+	static const dialect *find(const std::string &name);
+	static const dialect &standard(); // mpw
+};
+
+#endif
@@ -0,0 +1,465 @@
+#include "diff.h"
+#include "disassembler.h"
+#include "inline_params.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+
+
+namespace {
+
+	enum {
+		kCode,
+		kByte,
+		kWord,
+		kString,
+	};
+
+	const uint32_t kNone = ~UINT32_C(0);
+
+	struct record {
+		uint32_t address = 0;
+		uint32_t arg = 0;
+		uint32_t target = kNone; // reference within the module
+		uint16_t size = 0;       // total bytes
+		uint8_t op = 0;
+		uint8_t kind = kByte;
+		uint64_t key = 0;
+		const uint8_t *data = nullptr;
+	};
+
+	// delta for old addresses [begin, end).
+	struct relocation {
+		uint32_t begin;
+		uint32_t end;
+		int32_t delta;
+	};
+
+	struct match {
+		unsigned a;
+		unsigned b;
+		unsigned length;
+	};
+
+
+	uint32_t fnv(const uint8_t *data, unsigned size) {
+		uint32_t h = 2166136261;
+		for (unsigned i = 0; i < size; ++i) {
+			h ^= data[i];
+			h *= 16777619;
+		}
+		return h;
+	}
+
+
+	class decoder {
+	public:
+		decoder(const module &m, std::vector<record> &out) : _m(m), _out(out)
+		{}
+
+		void code(const uint8_t *p, const uint8_t *end);
+		void data(const uint8_t *p, const uint8_t *end);
+		void words(const uint8_t *p, const uint8_t *end);
+		void bytes(const uint8_t *p, const uint8_t *end);
+
+	private:
+
+		uint32_t address(const uint8_t *p) const { return _m.h.org + (p - _m.begin); }
+		bool internal(uint32_t x) const {
+			return x >= _m.address_space.first && x < _m.address_space.second;
+		}
+
+		void add(record r);
+		const uint8_t *add_word(const uint8_t *p);
+		const uint8_t *add_string(const uint8_t *p, const uint8_t *end, bool msb);
+		const uint8_t *add_inline(const char *layout, const uint8_t *p, const uint8_t *end);
+
+		const module &_m;
+		std::vector<record> &_out;
+	};
+
+	void decoder::add(record r) {
+
+		uint32_t shape = r.arg;
+		if (r.target != kNone) {
+			if (internal(r.target)) shape = kNone;
+			else r.target = kNone;
+		}
+
+		r.key = (uint64_t)r.kind << 56
+			| (uint64_t)r.op << 48
+			| (uint64_t)r.size << 32
+			| shape;
+		_out.push_back(r);
+	}
+
+	const uint8_t *decoder::add_word(const uint8_t *p) {
+		record r;
+		r.address = address(p);
+		r.kind = kWord;
+		r.size = 2;
+		r.data = p;
+		r.arg = r.target = le_view(p, 2).u16(0);
+		add(r);
+		return p + 2;
+	}
+
+	const uint8_t *decoder::add_string(const uint8_t *p, const uint8_t *end, bool msb) {
+		const uint8_t *begin = p;
+		while (p < end) {
+			uint8_t c = *p++;
+			if (msb ? (c & 0x80) : !c) break;
+		}
+		record r;
+		r.address = address(begin);
+		r.kind = kString;
+		r.size = p - begin;
+		r.data = begin;
+		r.arg = fnv(begin, r.size);
+		add(r);
+		return p;
+	}
+
+	const uint8_t *decoder::add_inline(const char *layout, const uint8_t *p, const uint8_t *end) {
+
+		for (; *layout && p < end; ++layout) {
+			switch(*layout) {
+				case 'p':
+					if (end - p < 2) return p;
+					p = add_word(p);
+					break;
+				case 'w': {
+					if (end - p < 2) return p;
+					record r;
+					r.address = address(p);
+					r.kind = kWord;
+					r.size = 2;
+					r.data = p;
+					r.arg = le_view(p, 2).u16(0);
+					add(r);
+					p += 2;
+					break;
+				}
+				case 'z':
+					p = add_string(p, end, false);
+					break;
+				case 'h':
+					p = add_string(p, end, true);
+					break;
+				default: {
+					record r;
+					r.address = address(p);
+					r.size = 1;
+					r.data = p;
+					r.arg = *p++;
+					add(r);
+					break;
+				}
+			}
+		}
+		return p;
+	}
+
+	void decoder::code(const uint8_t *p, const uint8_t *end) {
+
+		const auto &params = inline_params::standard();
+
+		while (p < end) {
+			uint8_t op = *p;
+			unsigned size = disassembler::operand_size(op, false, false);
+			if (end - p < 1 + size) {
+				bytes(p, end);
+				return;
+			}
+
+			record r;
+			r.address = address(p);
+			r.kind = kCode;
+			r.op = op;
+			r.size = 1 + size;
+			r.data = p;
+			for (unsigned i = 0; i < size; ++i)
+				r.arg |= p[1 + i] << (8 * i);
+
+			switch(disassembler::operand_mode(op) & 0xf000) {
+				case mRelative:
+					r.target = disassembler::relative_address(r.address, size, r.arg);
+					break;
+				case mAbsolute:
+				case mAbsoluteI:
+				case mAbsoluteLong:
+					if (size > 1)
+						r.target = disassembler::absolute_address(r.address, op, size, r.arg);
+					break;
+			}
+			add(r);
+			p += r.size;
+
+			const char *layout = op == 0x20 ? params.find(r.arg) : nullptr;
+			if (layout) p = add_inline(layout, p, end);
+		}
+	}
+
+	void decoder::words(const uint8_t *p, const uint8_t *end) {
+		while (end - p >= 2) p = add_word(p);
+		bytes(p, end);
+	}
+
+	// code regions and jump tables found by analyze(), bytes otherwise.
+	void decoder::data(const uint8_t *p, const uint8_t *end) {
+
+		auto region = _m.code_regions.begin();
+		auto table = _m.jump_tables.begin();
+
+		while (p < end) {
+			uint32_t pc = address(p);
+
+			while (region != _m.code_regions.end() && pc >= region->end) ++region;
+			if (region != _m.code_regions.end() && pc >= region->begin) {
+				const uint8_t *e = _m.begin + (region->end - _m.h.org);
+				code(p, std::min(e, end));
+				p = std::min(e, end);
+				continue;
+			}
+
+			while (table != _m.jump_tables.end() && pc >= table->second) ++table;
+			if (table != _m.jump_tables.end() && pc >= table->first && pc + 2 <= table->second
+				&& end - p >= 2) {
+				p = add_word(p);
+				continue;
+			}
+
+			bytes(p, p + 1);
+			++p;
+		}
+	}
+
+	void decoder::bytes(const uint8_t *p, const uint8_t *end) {
+		while (p < end) {
+			record r;
+			r.address = address(p);
+			r.size = 1;
+			r.data = p;
+			r.arg = *p++;
+			add(r);
+		}
+	}
+
+
+	std::vector<record> decode(const module &m) {
+
+		std::vector<record> rv;
+		decoder d(m, rv);
+
+		d.code(m.begin, m.end_code);
+		// code terminator
+		d.data(m.end_code, std::min(m.end_code + 1, m.end_immediate));
+		d.words(std::min(m.end_code + 1, m.end_immediate), m.end_immediate);
+		d.data(m.end_immediate, m.end);
+		return rv;
+	}
+
+
+	// histogram diff:  anchor each range on its least frequent common
+	// key, extend the match in both directions and recurse on either side.
+	std::vector<match> align(const std::vector<record> &a, const std::vector<record> &b) {
+
+		struct range {
+			unsigned alo, ahi, blo, bhi;
+		};
+
+		const unsigned kMaxOccurrences = 64;
+
+		std::vector<match> rv;
+		std::vector<range> work;
+		work.push_back({0, (unsigned)a.size(), 0, (unsigned)b.size()});
+
+		struct entry {
+			unsigned count;
+			unsigned first;
+		};
+		std::unordered_map<uint64_t, entry> histogram;
+
+		while (!work.empty()) {
+			range r = work.back();
+			work.pop_back();
+
+			// common prefix/suffix
+			unsigned n = 0;
+			while (r.alo + n < r.ahi && r.blo + n < r.bhi && a[r.alo + n].key == b[r.blo + n].key) ++n;
+			if (n) rv.push_back({r.alo, r.blo, n});
+			r.alo += n;
+			r.blo += n;
+
+			n = 0;
+			while (r.ahi - n > r.alo && r.bhi - n > r.blo && a[r.ahi - n - 1].key == b[r.bhi - n - 1].key) ++n;
+			if (n) rv.push_back({r.ahi - n, r.bhi - n, n});
+			r.ahi -= n;
+			r.bhi -= n;
+
+			if (r.alo == r.ahi || r.blo == r.bhi) continue;
+
+			histogram.clear();
+			for (unsigned i = r.alo; i < r.ahi; ++i) {
+				auto &e = histogram[a[i].key];
+				if (!e.count++) e.first = i;
+			}
+
+			unsigned best = kMaxOccurrences + 1;
+			unsigned ai = 0, bi = 0;
+			for (unsigned j = r.blo; j < r.bhi; ++j) {
+				auto iter = histogram.find(b[j].key);
+				if (iter == histogram.end() || iter->second.count >= best) continue;
+				best = iter->second.count;
+				ai = iter->second.first;
+				bi = j;
+				if (best == 1) break;
+			}
+			if (best > kMaxOccurrences) continue;
+
+			unsigned begin_a = ai, begin_b = bi;
+			while (begin_a > r.alo && begin_b > r.blo && a[begin_a - 1].key == b[begin_b - 1].key) {
+				--begin_a;
+				--begin_b;
+			}
+			unsigned end_a = ai + 1, end_b = bi + 1;
+			while (end_a < r.ahi && end_b < r.bhi && a[end_a].key == b[end_b].key) {
+				++end_a;
+				++end_b;
+			}
+
+			rv.push_back({begin_a, begin_b, end_a - begin_a});
+			work.push_back({r.alo, begin_a, r.blo, begin_b});
+			work.push_back({end_a, r.ahi, end_b, r.bhi});
+		}
+
+		std::sort(rv.begin(), rv.end(), [](const match &x, const match &y){
+			return x.a < y.a;
+		});
+		return rv;
+	}
+
+
+	std::string text(const record &r) {
+
+		std::string tmp;
+
+		switch(r.kind) {
+			case kCode: {
+				tmp = disassembler::mnemonic(r.op);
+				if (r.size == 1) break;
+				unsigned mode = disassembler::operand_mode(r.op);
+				uint32_t value = r.arg;
+				if ((mode & 0xf000) == mRelative)
+					value = disassembler::relative_address(r.address, r.size - 1, r.arg);
+				tmp += "  ";
+				tmp += disassembler::prefix(mode, r.size - 1);
+				tmp += disassembler::to_x(value, (mode & 0xf000) == mRelative ? 4 : (r.size - 1) * 2, '$');
+				tmp += disassembler::suffix(mode);
+				break;
+			}
+			case kWord:
+				tmp = "dc.w  " + disassembler::to_x(r.arg, 4, '$');
+				break;
+			case kString:
+				tmp = "dc.b  ";
+				for (unsigned i = 0; i < r.size; ++i) {
+					if (i) tmp += ", ";
+					tmp += disassembler::to_x(r.data[i], 2, '$');
+				}
+				break;
+			default:
+				tmp = "dc.b  " + disassembler::to_x(r.arg, 2, '$');
+				break;
+		}
+		return tmp;
+	}
+
+	std::string delta_text(int32_t delta) {
+		return (delta < 0 ? "-" : "+") + disassembler::to_x(std::abs(delta), 4, '$');
+	}
+}
+
+
+unsigned diff(const std::string &old_name, const module &ma,
+	const std::string &new_name, const module &mb) {
+
+	auto a = decode(ma);
+	auto b = decode(mb);
+	auto matches = align(a, b);
+
+	// relocation runs, by old address.
+	std::vector<relocation> relocations;
+	for (const auto &m : matches) {
+		for (unsigned k = 0; k < m.length; ++k) {
+			const auto &x = a[m.a + k];
+			int32_t delta = b[m.b + k].address - x.address;
+			if (!relocations.empty() && relocations.back().delta == delta
+				&& relocations.back().end == x.address) {
+				relocations.back().end = x.address + x.size;
+				continue;
+			}
+			relocations.push_back({x.address, x.address + x.size, delta});
+		}
+	}
+
+	auto relocate = [&](uint32_t x) -> uint32_t {
+		auto iter = std::upper_bound(relocations.begin(), relocations.end(), x, [](uint32_t x, const relocation &r){
+			return x < r.begin;
+		});
+		if (iter == relocations.begin()) return kNone;
+		--iter;
+		if (x >= iter->end) return kNone;
+		return x + iter->delta;
+	};
+
+
+	printf("--- %s  id $%04x, size $%04x, org $%04x\n", old_name.c_str(), ma.h.id, ma.h.size, ma.h.org);
+	printf("+++ %s  id $%04x, size $%04x, org $%04x\n", new_name.c_str(), mb.h.id, mb.h.size, mb.h.org);
+
+	unsigned changes = 0;
+
+	auto hunk = [&](unsigned alo, unsigned ahi, unsigned blo, unsigned bhi){
+		uint32_t pa = alo < a.size() ? a[alo].address : ma.address_space.second;
+		uint32_t pb = blo < b.size() ? b[blo].address : mb.address_space.second;
+		printf("@@ -%s,%u +%s,%u @@\n",
+			disassembler::to_x(pa, 4, '$').c_str(), ahi - alo,
+			disassembler::to_x(pb, 4, '$').c_str(), bhi - blo);
+		for (unsigned i = alo; i < ahi; ++i)
+			printf("-%s: %s\n", disassembler::to_x(a[i].address, 4).c_str(), text(a[i]).c_str());
+		for (unsigned j = blo; j < bhi; ++j)
+			printf("+%s: %s\n", disassembler::to_x(b[j].address, 4).c_str(), text(b[j]).c_str());
+		++changes;
+	};
+
+	unsigned i = 0, j = 0;
+	matches.push_back({(unsigned)a.size(), (unsigned)b.size(), 0});
+	for (const auto &m : matches) {
+		if (i < m.a || j < m.b) hunk(i, m.a, j, m.b);
+
+		// same shape -- but does the reference still point to the same thing?
+		for (unsigned k = 0; k < m.length; ++k) {
+			const auto &x = a[m.a + k];
+			const auto &y = b[m.b + k];
+			if (x.target == kNone) continue;
+			if (relocate(x.target) != y.target) hunk(m.a + k, m.a + k + 1, m.b + k, m.b + k + 1);
+		}
+
+		i = m.a + m.length;
+		j = m.b + m.length;
+	}
+
+	puts("");
+	puts("relocation:");
+	for (const auto &r : relocations) {
+		printf("  %s-%s  %s\n",
+			disassembler::to_x(r.begin, 4, '$').c_str(),
+			disassembler::to_x(r.end - 1, 4, '$').c_str(),
+			delta_text(r.delta).c_str());
+	}
+	printf("%u change%s\n", changes, changes == 1 ? "" : "s");
+	return changes;
+}
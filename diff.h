@@ -0,0 +1,18 @@
+#ifndef __diff_h__
+#define __diff_h__
+
+#include <string>
+
+#include "omm.h"
+
+// instruction-aligned comparison of two versions of a module.
+// both are decoded into records (instructions, inline parameters,
+// table words, data bytes) keyed on opcode and operand shape --
+// references within the module are compared by relocation, not
+// value -- and aligned with a histogram diff.
+// returns the number of changes.
+
+unsigned diff(const std::string &old_name, const module &a,
+	const std::string &new_name, const module &b);
+
+#endif
@@ -1,4 +1,5 @@
 #include "disassembler.h"
+#include "cycles.h"
 #include <stdio.h>
 #include <string.h>
 #include <string>
@@ -39,26 +40,6 @@ static constexpr const char opcodes[] =
 	"sedsbcplxxcejsrsbcincsbc"
 	;
 
-static constexpr const int mImplied =      0x0000;
-static constexpr const int mImmediate =    0x1000;
-static constexpr const int mAbsolute =     0x2000;
-static constexpr const int mAbsoluteI =    0x3000;
-static constexpr const int mAbsoluteIL =   0x4000;
-static constexpr const int mAbsoluteLong = 0x5000;
-static constexpr const int mDP =           0x6000;
-static constexpr const int mDPI =          0x7000;
-static constexpr const int mDPIL =         0x8000;
-static constexpr const int mRelative =     0x9000;
-static constexpr const int mBlockMove =    0xa000;
-static constexpr const int mImpliedA =     0xb000; // inc a, dec a, etc.
-
-static constexpr const int m_S =          0x0100;
-static constexpr const int m_X =          0x0200;
-static constexpr const int m_Y =          0x0400;
-
-static constexpr const int m_M =          0x0020;
-static constexpr const int m_I =          0x0010;
-
 static constexpr const int modes[] =
 {
 	1 | mAbsolute,              // 00 brk #imm
@@ -335,7 +316,49 @@ static constexpr const int modes[] =
 
 };
 
-static bool branchlike(uint8_t op) {
+bool disassembler::terminal(uint8_t op) {
+
+	switch(op) {
+		case 0x40: // rti
+		case 0x4c: // jmp
+		case 0x5c: // jml
+		case 0x60: // rts
+		case 0x6b: // rtl
+		case 0x6c: // jmp ()
+		case 0x7c: // jmp (,x)
+		case 0x80: // bra
+		case 0x82: // brl
+		case 0xdc: // jml []
+			return true;
+		default:
+			return false;
+	}
+}
+
+std::string disassembler::mnemonic(uint8_t op) {
+	return std::string(&opcodes[op * 3], 3);
+}
+
+// branches wrap within the program bank.
+uint32_t disassembler::relative_address(uint32_t pc, unsigned size, uint32_t arg) {
+
+	uint32_t rv = pc + 1 + size + arg;
+	if ((size == 1) && (arg & 0x80))
+		rv += 0xff00;
+	return (pc & 0xff0000) | (rv & 0xffff);
+}
+
+// absolute operands are in the program bank (well, the data bank, but
+// phk/plb makes them the same).  jmp (abs) and jml [abs] pointers
+// are always in bank 0.
+uint32_t disassembler::absolute_address(uint32_t pc, uint8_t op, unsigned size, uint32_t arg) {
+
+	if (size == 3) return arg;
+	if (size == 1 || op == 0x6c || op == 0xdc) return arg;
+	return (pc & 0xff0000) | arg;
+}
+
+bool disassembler::branchlike(uint8_t op) {
 
 	switch(op) {
 		case 0x10: // bpl
@@ -402,6 +425,10 @@ std::string disassembler::to_x(uint32_t x, unsigned bytes, char prefix) {
 	return s;
 }
 
+unsigned disassembler::operand_mode(uint8_t op) {
+	return modes[op];
+}
+
 int disassembler::operand_size(uint8_t op, bool m, bool x) {
 	unsigned mode = modes[op];
 	unsigned size = mode & 0x0f;
@@ -412,9 +439,12 @@ int disassembler::operand_size(uint8_t op, bool m, bool x) {
 
 
 
+thread_local FILE *disassembler::_output = nullptr;
+thread_local line_index *disassembler::_index = nullptr;
+
 void disassembler::emit(const std::string &label) {
-	fputs(label.c_str(), stdout);
-	fputc('\n', stdout);
+	write(label);
+	write("\n", 1);
 }
 
 void disassembler::emit(const std::string &label, const std::string &opcode) {
@@ -427,7 +457,7 @@ void disassembler::emit(const std::string &label, const std::string &opcode) {
 	}
 
 	tmp.push_back('\n');
-	fputs(tmp.c_str(), stdout);
+	write(tmp);
 }
 
 
@@ -449,7 +479,7 @@ void disassembler::emit(const std::string &label, const std::string &opcode, con
 	}
 
 	tmp.push_back('\n');
-	fputs(tmp.c_str(), stdout);
+	write(tmp);
 }
 
 
@@ -475,18 +505,43 @@ void disassembler::emit(const std::string &label, const std::string &opcode, con
 	}
 
 	tmp.push_back('\n');
-	fputs(tmp.c_str(), stdout);
+	write(tmp);
 }
 
 
 
 
 
-void disassembler::reset() {
+void disassembler::next_instruction() {
 	_arg = 0;
 	_st = 0;
 }
 
+// back to a new disassembler, but keep the traits and any buffers.
+void disassembler::reset() {
+	next_instruction();
+	_op = 0;
+	_size = 0;
+	_mode = 0;
+	_flags = 0x30;
+	_pc = 0;
+	_code = true;
+	_inline_data = 0;
+	_next_label = -1;
+	_params = &inline_params::standard();
+	_layout = nullptr;
+	_cpu = 0;
+	_dp = 0;
+	_marks.clear();
+	_cycles = 0;
+	_pages = 0;
+	_block = 0;
+	_taken = 0;
+	_loop.clear();
+	_observers.clear();
+	_events.clear();
+}
+
 
 std::pair<std::string, std::string> 
 disassembler::format_data(unsigned size, const uint8_t *data) {
@@ -535,10 +590,12 @@ void disassembler::dump() {
 
 	hexdump(line);
 	line.push_back('\n');
-	fputs(line.c_str(), stdout);
+	mark_line(_pc);
+	write(line);
 
+	post(decode_event::data, 0, bytes(0, _st), _st);
 	_pc += _st;
-	reset();
+	next_instruction();
 }
 
 void disassembler::dump(const std::string &expr, unsigned size, uint32_t value) {
@@ -561,15 +618,18 @@ void disassembler::dump(const std::string &expr, unsigned size, uint32_t value)
 
 	hexdump(line);
 	line.push_back('\n');
-	fputs(line.c_str(), stdout);
+	mark_line(_pc);
+	write(line);
 
+	post(decode_event::data, 0, bytes(0, _st), _st);
 	_pc += _st;
-	reset();
+	next_instruction();
 }
 
 void disassembler::flush() {
 	if (_st) dump();
 	check_labels();
+	end_block();
 }
 
 
@@ -578,23 +638,30 @@ void disassembler::check_labels() {
 	if ( _next_label >= 0 && _pc + _st >= _next_label) {
 		//flush(); // -- too recursive.  see above.
 		if (_st) dump();
+		end_block();
+		if (_next_label == _pc) {
+			mark_line(_pc);
+			post(decode_event::label, 0, 0);
+		}
 		_next_label = next_label(_pc);
 	}
 
 }
 
 
-void disassembler::space(unsigned size) {
+void disassembler::fill(unsigned size, uint8_t value) {
 	flush();
 
 	std::string line;
 
-	indent_to(line, kOpcodeTab);
-	line += ds();
-	indent_to(line, kOperandTab);
-
-
 	while (size) {
+		if (_next_label == _pc) {
+			mark_line(_pc);
+			post(decode_event::label, 0, 0);
+			_next_label = next_label(_pc);
+			continue;
+		}
+
 		uint32_t chunk;
 		if (_next_label == -1) chunk = size;
 		else {
@@ -602,20 +669,30 @@ void disassembler::space(unsigned size) {
 			chunk = std::min(chunk, size);
 		}
 
-		line.resize(kOperandTab);
-		line += std::to_string(chunk);
+		auto p = value ? format_fill(chunk, value) : std::make_pair(ds(), std::to_string(chunk));
+
+		line.clear();
+		indent_to(line, kOpcodeTab);
+		line += p.first;
+		indent_to(line, kOperandTab);
+		line += p.second;
 		indent_to(line, kCommentTab);
 		line += "; ";
 
 		line += to_x(_pc, 4);
 		line.push_back(':');
 		line.push_back('\n');
-		fputs(line.c_str(), stdout);	
-
+		mark_line(_pc);
+		write(line);
 
+		post(decode_event::space, 0, value, chunk);
 		_pc += chunk;
 		size -= chunk;
-		if (_next_label == _pc) _next_label = next_label(_pc);
+		if (_next_label == _pc) {
+			mark_line(_pc);
+			post(decode_event::label, 0, 0);
+			_next_label = next_label(_pc);
+		}
 	}
 
 
@@ -631,10 +708,7 @@ void disassembler::operator()(const std::string &expr, unsigned size, uint32_t v
 		dump(expr, size, value);
 		if (_inline_data) {
 			_inline_data -= size;
-			if (_inline_data <= 0) {
-				_prodos_mli = 0;
-				_code = true;
-			}
+			if (_inline_data <= 0) _code = true;
 		}
 		return;
 	}
@@ -660,27 +734,8 @@ void disassembler::operator()(uint8_t byte) {
 	if (!_code) {
 		_bytes[_st++] = byte;
 
-		if (_prodos_mli) {
-			unsigned addr;
-			std::string label;
-			--_inline_data;
-			switch(--_prodos_mli) {
-				case 0:
-					// parameter list (2-bytes)
-					addr = _bytes[0] | (_bytes[1] << 8);
-					label = label_for_address(addr);
-					if (label.empty()) dump();
-					else {
-						_st = 0;
-						dump(label, 2, addr);
-					}
-					_code = true;
-				case 1:
-					break;
-				case 2:
-					dump(); // command (1-byte)
-					break;
-			}
+		if (_layout) {
+			inline_field(byte);
 			return;
 		}
 
@@ -715,7 +770,10 @@ void disassembler::operator()(uint8_t byte) {
 		if (!_size) {
 			print();
 
-			if (branchlike(byte)) fputs("\n", stdout);
+			if (branchlike(byte)) {
+				end_block();
+				write("\n", 1);
+			}
 		}
 		return;
 	}
@@ -740,9 +798,13 @@ void disassembler::operator()(uint8_t byte) {
 	// all done... now print it.
 	print();
 
-	if (branchlike(op)) fputs("\n", stdout);
+	if (branchlike(op)) {
+		end_block();
+		write("\n", 1);
+	}
 
-	// todo -- subscribe to before/after events...
+	// subclass hook for mode and bank changes.  Everything else goes
+	// to the observers.
 	switch(op) {
 		case 0xc2:
 		case 0xe2:
@@ -753,21 +815,65 @@ void disassembler::operator()(uint8_t byte) {
 			break;
 	}
 
-	if (op == 0x20 && arg == 0xbf00) {
-		_prodos_mli = 3;
-		_inline_data = 3;
-		_code = false;
+	// jsr to a routine with inline parameters.
+	if (op == 0x20 && _params) {
+		_layout = _params->find(arg);
+		if (_layout) _code = false;
 	}
 
 
 }
 
 
-std::string disassembler::prefix() {
+void disassembler::inline_field(uint8_t byte) {
+
+	switch(*_layout) {
+		case 'b':
+			dump();
+			break;
+
+		case 'w':
+		case 'p': {
+			if (_st < 2) return;
+
+			unsigned addr = _bytes[0] | (_bytes[1] << 8);
+			std::string label;
+
+			if (*_layout == 'w') label = to_x(addr, 4, '$');
+			else label = label_for_address(addr);
+
+			if (label.empty()) dump();
+			else {
+				_st = 0;
+				dump(label, 2, addr);
+			}
+			break;
+		}
+
+		case 'z':
+			if (byte == 0 || _st == 4) dump();
+			if (byte != 0) return;
+			break;
+
+		case 'h':
+			if ((byte & 0x80) || _st == 4) dump();
+			if (!(byte & 0x80)) return;
+			break;
+	}
+
+	// next field.
+	if (!*++_layout) {
+		_layout = nullptr;
+		_code = true;
+	}
+}
+
+
+std::string disassembler::prefix(unsigned mode, unsigned size, unsigned traits) {
 
 	std::string tmp;
 
-	switch(_mode & 0xf000) {
+	switch(mode & 0xf000) {
 		case mImmediate: tmp = "#"; break;
 		case mDP: tmp = "<"; break;
 		case mDPI: tmp = "(<"; break;
@@ -780,30 +886,41 @@ std::string disassembler::prefix() {
 
 		// cop, brk are treated as absolute.
 		case mAbsolute: 
-			//if (_size == 1) printf("\t");
-			if (_size > 1) tmp = "|";
+			//if (size == 1) printf("\t");
+			if (size > 1) tmp = "|";
 			break;
 		case mAbsoluteLong: tmp = ">"; break;
 		case mAbsoluteI: tmp = "("; break;
 	}
+
+	if (traits & (ca65_size_prefix | no_size_prefix)) {
+		bool ca65 = traits & ca65_size_prefix;
+		switch(mode & 0xf000) {
+			case mDP: tmp = ca65 ? "z:" : ""; break;
+			case mDPI: tmp = ca65 ? "(z:" : "("; break;
+			case mDPIL: tmp = ca65 ? "[z:" : "["; break;
+			case mAbsolute: if (size > 1) tmp = ca65 ? "a:" : ""; break;
+			case mAbsoluteLong: if (ca65) tmp = "f:"; break;
+		}
+	}
 	return tmp;
 }
 
 
 
-std::string disassembler::suffix() {
+std::string disassembler::suffix(unsigned mode) {
 
 	std::string tmp;
 
-	switch(_mode & 0x0f00) {
+	switch(mode & 0x0f00) {
 		case m_X: tmp = ",x"; break;
-		case m_Y: if (!(_mode & (mDPI|mDPIL))) tmp = ",y"; break;
+		case m_Y: if (!(mode & (mDPI|mDPIL))) tmp = ",y"; break;
 		case m_S:
 		case m_S | m_Y:
 			tmp = ",s"; break;
 	}
 
-	switch(_mode & 0xf000) {
+	switch(mode & 0xf000) {
 		case mAbsoluteI:
 		case mDPI:
 			tmp += ")"; break;
@@ -815,9 +932,9 @@ std::string disassembler::suffix() {
 	// (xxx,s),y
 	// (xxx),y
 	// [xxx],y
-	switch(_mode & 0x0f00) {
+	switch(mode & 0x0f00) {
 		case m_Y:
-			if (_mode & (mDPI|mDPIL)) tmp += ",y"; break;
+			if (mode & (mDPI|mDPIL)) tmp += ",y"; break;
 		case m_S | m_Y:
 			tmp += ",y"; break;
 	}	
@@ -826,33 +943,259 @@ std::string disassembler::suffix() {
 }
 
 
-void disassembler::hexdump(std::string &line) {
+namespace {
+
+	// 4 bytes (first in the low byte) to 8 lowercase hex digits, one
+	// per byte lane, most significant nybble first.  No branches.
+	uint64_t hex_digits(uint32_t v) {
+		uint64_t x = v;
+		x = (x | x << 16) & UINT64_C(0x0000ffff0000ffff);
+		x = (x | x << 8) & UINT64_C(0x00ff00ff00ff00ff);
+		x = ((x >> 4) & UINT64_C(0x000f000f000f000f)) | ((x & UINT64_C(0x000f000f000f000f)) << 8);
+		uint64_t letters = ((x + UINT64_C(0x0606060606060606)) >> 4) & UINT64_C(0x0101010101010101);
+		return x + UINT64_C(0x3030303030303030) + letters * ('a' - '0' - 10);
+	}
+
+	// hexdump ascii column.  [1] ignores the msb.
+	struct ascii_table {
+		char c[2][256];
+
+		ascii_table() {
+			for (unsigned i = 0; i < 256; ++i) {
+				c[0][i] = i >= 0x20 && i < 0x7f ? i : '.';
+				c[1][i] = c[0][i & 0x7f];
+			}
+		}
+	};
+
+	const ascii_table ascii;
+
+	// how many times *begin repeats, 8 bytes at a time.
+	size_t run_length(const uint8_t *begin, const uint8_t *end) {
+		const uint8_t c = *begin;
+		const uint64_t pattern = c * UINT64_C(0x0101010101010101);
+		const uint8_t *iter = begin;
+
+		while (end - iter >= 8) {
+			uint64_t x;
+			memcpy(&x, iter, 8);
+			if (x != pattern) break;
+			iter += 8;
+		}
+		while (iter != end && *iter == c) ++iter;
+		return iter - begin;
+	}
+}
+
+void disassembler::hexdump(std::string &line, uint32_t pc, const uint8_t *data, unsigned size, unsigned traits) {
 	// print pc and hexdump...
 
 	indent_to(line, kCommentTab);
 	line += "; ";
 
-	line += to_x(_pc, 4);
+	char tmp[12];
+
+	if (pc > 0xffff) line += to_x(pc, 4);
+	else {
+		uint64_t x = hex_digits((pc >> 8) | (pc & 0xff) << 8);
+		for (unsigned i = 0; i < 4; ++i) tmp[i] = x >> (8 * i);
+		line.append(tmp, 4);
+	}
 	line.push_back(':');
 
-	int i;
-	for (i = 0; i < _st; ++i) {
-		line.push_back(' ');
-		line += to_x(_bytes[i], 2);
+	uint32_t v = 0;
+	for (unsigned i = 0; i < size; ++i) v |= data[i] << (8 * i);
+	uint64_t x = hex_digits(v);
+
+	memset(tmp, ' ', sizeof(tmp));
+	for (unsigned i = 0; i < size; ++i) {
+		tmp[i * 3 + 1] = x >> (16 * i);
+		tmp[i * 3 + 2] = x >> (16 * i + 8);
 	}
-	for ( ; i < 4; ++i) {
-		line += "   ";
+	line.append(tmp, sizeof(tmp));
+	line += "  ";
+
+	const char *table = ascii.c[traits & msb_hexdump ? 1 : 0];
+	for (unsigned i = 0; i < size; ++i) line.push_back(table[data[i]]);
+}
+
+
+const uint8_t *disassembler::data(const uint8_t *iter, const uint8_t *end, const uint8_t *stop) {
+
+	if (!stop) stop = end;
+
+	if (_code || _layout || _inline_data) {
+		while (iter != end && (iter < stop || _st)) (*this)(*iter++);
+		return iter;
 	}
+
+	std::string buffer;
+	std::string line;
+	buffer.reserve(std::min<size_t>(end - iter, 1024) * 30);
+
+	unsigned lines = 0;
+
+	auto flush_buffer = [&](){
+		write(buffer);
+		buffer.clear();
+		lines = 0;
+	};
+
+	while (iter != end) {
+		// finish a partial line.
+		if (_st) {
+			(*this)(*iter++);
+			continue;
+		}
+		if (iter >= stop) break;
+
+		if (_next_label >= 0 && _pc >= _next_label) {
+			flush_buffer();
+			check_labels();
+			continue;
+		}
+
+		// fills and lines stop at the next label.
+		const uint8_t *limit = end;
+		if (_next_label >= 0 && _next_label - _pc < end - iter) limit = iter + (_next_label - _pc);
+
+		size_t run = run_length(iter, limit);
+		if (run >= min_fill) {
+			flush_buffer();
+			fill(run, *iter);
+			iter += run;
+			continue;
+		}
+
+		unsigned n = std::min<size_t>(4, limit - iter);
+
+		// stop short of a fill.
+		for (unsigned i = 1; i < n; ++i) {
+			if (iter[i] != iter[i - 1] && run_length(iter + i, limit) >= min_fill) {
+				n = i;
+				break;
+			}
+		}
+
+		// a short line at the end stays pending, as it would byte by byte.
+		if (n < 4 && iter + n == end && _pc + n != _next_label) {
+			while (iter != end) (*this)(*iter++);
+			break;
+		}
+
+		auto p = format_data(n, iter);
+		line.clear();
+		indent_to(line, kOpcodeTab);
+		line += p.first;
+		indent_to(line, kOperandTab);
+		line += p.second;
+		hexdump(line, _pc, iter, n, _traits);
+		line.push_back('\n');
+		if (_index) _index->mark(_pc, buffer.size(), lines);
+		buffer += line;
+		++lines;
+
+		if (!_observers.empty()) {
+			uint32_t v = 0;
+			for (unsigned i = 0; i < n; ++i) v |= iter[i] << (8 * i);
+			post(decode_event::data, 0, v, n);
+		}
+		_pc += n;
+		iter += n;
+	}
+	flush_buffer();
+	return iter;
+}
+
+
+// cycles after the hexdump.  n, n+ (page crossing), or n/taken for branches.
+void disassembler::timing(std::string &line) {
+
+	if (!_cpu) return;
+
+	cycles c = cycle_count(_cpu, _op, _flags & 0x20, _flags & 0x10, _dp & 0xff);
+	unsigned count = c.count;
+	unsigned taken = c.taken;
+	bool page = c.page;
+	std::string note;
+
+	if (taken) {
+		uint32_t target = relative_address(_pc, _size, _arg);
+		if (c.branch_page && ((_pc + _size + 1) ^ target) & 0xff00) {
+			++taken;
+			note = " crosses page";
+		}
+		if (_op == 0x80) count = taken;
+
+		// a backwards branch closes a loop if we've seen the top.
+		auto iter = std::lower_bound(_marks.begin(), _marks.end(), target,
+			[](const mark &m, uint32_t pc){ return m.pc < pc; });
+		if (target <= _pc && iter != _marks.end() && iter->pc == target) {
+			_loop = "loop " + to_x(target, 4, '$') + "-" + to_x(_pc, 4, '$') + ": "
+				+ std::to_string(_cycles - iter->cycles + taken)
+				+ (_pages > iter->pages ? "+" : "") + " cycles";
+		}
+		_taken = taken - count;
+	}
+
+	if (page && (_mode & 0xf000) == mAbsolute && (_mode & (m_X | m_Y))) {
+		// an index into a labeled table on one page can't cross.
+		uint32_t base = absolute_address(_pc, _op, _size, _arg);
+		int32_t end = label_after(base);
+		if (end >= 0) {
+			if ((base ^ (end - 1)) & 0xff00) note = " table crosses page";
+			else page = false;
+		}
+	}
+
+	_marks.push_back(mark{ _pc, _cycles, _pages });
+	_cycles += count;
+	if (page) ++_pages;
+
+	if (!count) return;
+
+	line.append(4 - _st, ' ');
 	line += "  ";
-	for (i = 0; i < _st; ++i) {
-		uint8_t c = _bytes[i];
-		// msb flag?
-		if (_traits & msb_hexdump) c &= 0x7f;
-		if (isprint(c) && isascii(c)) line += c;
-		else line += '.';
+	line += std::to_string(count);
+	if (taken && _op != 0x80) line += "/" + std::to_string(taken);
+	if (page) line.push_back('+');
+	line += note;
+}
+
+// cycles for the instructions since the last label or branch.  A
+// single instruction already has its count.
+void disassembler::end_block() {
+
+	if (_cpu && _block + 1 < _marks.size()) {
+		const auto &first = _marks[_block];
+		unsigned n = _cycles - first.cycles;
+
+		std::string tmp = "block " + to_x(first.pc, 4, '$') + "-" + to_x(_marks.back().pc, 4, '$') + ": ";
+		tmp += std::to_string(n);
+		if (_taken) tmp += "/" + std::to_string(n + _taken);
+		if (_pages > first.pages) tmp.push_back('+');
+		tmp += " cycles";
+		emit("", "", "", tmp);
+		if (!_loop.empty()) emit("", "", "", _loop);
 	}
+
+	_block = _marks.size();
+	_taken = 0;
+	_loop.clear();
+
+	deliver();
 }
 
+void disassembler::deliver() {
+	if (_events.empty()) return;
+	for (auto o : _observers) o->events(_events.data(), _events.data() + _events.size());
+	_events.clear();
+}
+
+void disassembler::unsubscribe(decode_observer *o) {
+	deliver();
+	_observers.erase(std::remove(_observers.begin(), _observers.end(), o), _observers.end());
+}
 
 std::string disassembler::label_for_address(uint32_t address) { return ""; }
 std::string disassembler::label_for_zp(uint32_t address) { return ""; }
@@ -866,12 +1209,7 @@ void disassembler::print() {
 		switch(_mode & 0xf000) {
 			case mRelative: {
 
-				uint32_t pc = _pc + 1 + _size + _arg;
-
-				if ((_size == 1) && (_arg & 0x80))
-					pc += 0xff00;
-				pc &= 0xffff;
-
+				uint32_t pc = relative_address(_pc, _size, _arg);
 
 				// it would be really fancy if it checked for a label name @pc...
 				tmp = label_for_address(pc);
@@ -906,7 +1244,7 @@ void disassembler::print() {
 			case mAbsoluteI:
 			case mAbsoluteIL:
 			case mAbsoluteLong:
-				tmp = label_for_address(_arg);
+				tmp = label_for_address(absolute_address(_pc, _op, _size, _arg));
 				if (tmp.empty()) tmp = to_x(_arg, _size * 2, '$');
 				break;
 
@@ -934,10 +1272,13 @@ void disassembler::print() {
 
 
 	hexdump(line);
+	timing(line);
 	line.push_back('\n');
-	fputs(line.c_str(), stdout);
+	mark_line(_pc);
+	write(line);
+	post(decode_event::instruction, _op, 0, 0);
 	_pc += _size + 1;
-	reset();
+	next_instruction();
 }
 
 void disassembler::print(const std::string &expr) {
@@ -957,11 +1298,14 @@ void disassembler::print(const std::string &expr) {
 	}
 
 	hexdump(line);
+	timing(line);
 	line.push_back('\n');
-	fputs(line.c_str(), stdout);
+	mark_line(_pc);
+	write(line);
 
+	post(decode_event::instruction, _op, bytes(1, _size), _size);
 	_pc += _size + 1;
-	reset();	
+	next_instruction();	
 }
 
 
@@ -971,6 +1315,13 @@ const std::vector<uint32_t> &analyzer::finish() {
 	std::sort(_labels.begin(), _labels.end());
 	auto end = std::unique(_labels.begin(), _labels.end());
 	_labels.erase(end, _labels.end());
+
+	// something else may enter between the compare and the jump.
+	for (const auto &sp : _spans) {
+		auto iter = std::upper_bound(_labels.begin(), _labels.end(), sp.begin);
+		if (iter != _labels.end() && *iter <= sp.end) _tables[sp.table].count = 0;
+	}
+	_spans.clear();
 	return _labels;
 }
 
@@ -979,28 +1330,36 @@ void analyzer::operator()(uint8_t byte) {
 
 
 	if (!_code) {
+		_st++;
+
+		switch(*_layout) {
+			case 'b':
+				break;
 
-		if (_prodos_mli) {
-			_st++;
-			switch(--_prodos_mli) {
-				case 0:
-					_arg |= byte << 8;
-					_labels.push_back(_arg);
-					reset();
-					_code = true;
-					break;
-				case 1:
+			case 'w':
+			case 'p':
+				if (++_inline_st < 2) {
 					_arg = byte;
-				case 2:
-					// byte is cmd number.
-					break;
-			}
+					return;
+				}
+				if (*_layout == 'p') _labels.push_back(_arg | (byte << 8));
+				break;
+
+			case 'z':
+				if (byte != 0) return;
+				break;
+
+			case 'h':
+				if (!(byte & 0x80)) return;
+				break;
 		}
 
-		if (_inline_data && --_inline_data <= 0) {
+		// next field.
+		_inline_st = 0;
+		if (!*++_layout) {
+			_layout = nullptr;
 			_code = true;
-			reset();
-			return;
+			advance();
 		}
 		return;
 	}
@@ -1015,7 +1374,7 @@ void analyzer::operator()(uint8_t byte) {
 		if (_mode & _flags & m_I) _size++;
 		if (_mode & _flags & m_M) _size++;
 
-		if (!_size) { reset(); }
+		if (!_size) process();
 		return;
 	}
 	unsigned shift = (_st - 2) * 8;
@@ -1027,11 +1386,39 @@ void analyzer::operator()(uint8_t byte) {
 	process();
 }
 
-void analyzer::reset() {
+void analyzer::advance() {
 	_pc += _st;
 	_st = 0;
 }
 
+void analyzer::reset() {
+	_code = true;
+	_st = 0;
+	_op = 0;
+	_size = 0;
+	_flags = 0x30;
+	_pc = 0;
+	_arg = 0;
+	_mode = 0;
+	_layout = nullptr;
+	_inline_st = 0;
+	_limit = -1;
+	_limit_reg = 0;
+	_scaled = false;
+	_limit_st = 0;
+	_limit_pc = 0;
+	_dispatch = 0;
+	_dispatch_reg = 0;
+	_dispatch_lo = 0;
+	_dispatch_hi = 0;
+	_labels.clear();
+	_calls.clear();
+	_tables.clear();
+	_spans.clear();
+	_dp_reads.reset();
+	_dp_writes.reset();
+}
+
 void analyzer::process() {
 
 	if (_traits & disassembler::track_rep_sep) {
@@ -1046,28 +1433,164 @@ void analyzer::process() {
 	}
 
 	switch (_mode & 0xf000) {
-		case mRelative: {
-
-			uint32_t pc = _pc + 1 + _size + _arg;
-
-			if ((_size == 1) && (_arg & 0x80))
-				pc += 0xff00;
-			pc &= 0xffff;
-
-			_labels.push_back(pc);
+		case mRelative:
+			_labels.push_back(disassembler::relative_address(_pc, _size, _arg));
+			_calls.push_back(_labels.back());
 			break;
-		}
 		case mAbsolute:
 		case mAbsoluteI:
-		case mAbsoluteLong: {
-			_labels.push_back(_arg);
+		case mAbsoluteLong:
+			_labels.push_back(disassembler::absolute_address(_pc, _op, _size, _arg));
+			if (_op == 0x20 || _op == 0x4c) _calls.push_back(_labels.back());
 			break;
+	}
+
+	direct_page();
+	find_tables();
+
+	if (_op == 0x20 && _params) {
+		_layout = _params->find(_arg);
+		if (_layout) {
+			_code = false;
+			return;
 		}
 	}
-	if (_op == 0x20 && _arg == 0xbf00) {
-		_code = false;
-		_prodos_mli = 3;
-		return;
+	advance();
+}
+
+void analyzer::direct_page() {
+
+	unsigned mode = _mode & 0xf000;
+	if (mode != mDP && mode != mDPI && mode != mDPIL) return;
+	if (_mode & m_S) return; // stack relative
+
+	bool read = true;
+	bool write = false;
+	unsigned width = (_flags & 0x20) ? 2 : 1;
+
+	// the pointer is read, not written, for (dp) and [dp].
+	if (mode == mDPI) width = 2;
+	else if (mode == mDPIL) width = 3;
+	else switch(_op) {
+		case 0x84: case 0x86: case 0x94: case 0x96: // sty/stx
+			read = false;
+			write = true;
+			width = (_flags & 0x10) ? 2 : 1;
+			break;
+
+		case 0xa4: case 0xa6: case 0xb4: case 0xb6: // ldy/ldx
+		case 0xc4: case 0xe4: // cpy/cpx
+			width = (_flags & 0x10) ? 2 : 1;
+			break;
+
+		case 0x85: case 0x95: // sta
+		case 0x64: case 0x74: // stz
+			read = false;
+			write = true;
+			break;
+
+		case 0x04: case 0x14: // tsb/trb
+		case 0x06: case 0x16: case 0x26: case 0x36: // asl/rol
+		case 0x46: case 0x56: case 0x66: case 0x76: // lsr/ror
+		case 0xc6: case 0xd6: case 0xe6: case 0xf6: // dec/inc
+			write = true;
+			break;
+
+		case 0xd4: // pei
+			width = 2;
+			break;
+	}
+
+	for (unsigned i = 0; i < width; ++i) {
+		unsigned address = (_arg + i) & 0xff;
+		if (read) _dp_reads.set(address);
+		if (write) _dp_writes.set(address);
+	}
+}
+
+void analyzer::find_tables() {
+
+	// cmp #n / bcs / asl a / tax / jmp (table,x)
+	// cpx #n / bcs / jmp (table,x)
+	// lda hi,x / pha / lda lo,x / pha / rts
+
+	// a compare only counts for the next few instructions.
+	static constexpr const unsigned window = 8;
+	if (_limit >= 0 && ++_limit_st > window) _limit = -1;
+
+	auto count = [this](char reg) -> int {
+		if (_limit < 0 || _limit_reg != reg) return -1;
+		return _limit;
+	};
+
+	auto push = [this](uint32_t address, uint32_t hi, int count) {
+		if (count >= 0) _spans.push_back(span{ _tables.size(), _limit_pc, _pc });
+		_tables.push_back(table{ address, hi, count < 0 ? 0u : (unsigned)count });
+	};
+
+	switch(_op) {
+		case 0xc9: // cmp #
+		case 0xe0: // cpx #
+		case 0xc0: // cpy #
+			_limit = _arg;
+			_limit_reg = _op == 0xc9 ? 'a' : _op == 0xe0 ? 'x' : 'y';
+			_limit_st = 0;
+			_limit_pc = _pc;
+			_scaled = false;
+			break;
+
+		case 0x0a: // asl a
+			if (_limit_reg == 'a' && !_scaled) _scaled = true;
+			else _limit = -1;
+			break;
+
+		case 0xaa: // tax
+		case 0xa8: // tay
+			if (_limit_reg == 'a') _limit_reg = _op == 0xaa ? 'x' : 'y';
+			else _limit = -1;
+			break;
+
+		case 0x90: // bcc
+		case 0xb0: // bcs
+			break;
+
+		case 0x6c: // jmp (abs)
+			_tables.push_back(table{ _arg, 0, 1 });
+			break;
+
+		case 0x7c: // jmp (abs,x)
+		case 0xfc: // jsr (abs,x)
+		{
+			int n = count('x');
+			if (n >= 0 && !_scaled) n = (n + 1) / 2;
+			push(_arg, 0, n);
+			break;
+		}
+
+		case 0xb9: // lda abs,y
+		case 0xbd: // lda abs,x
+		{
+			char reg = _op == 0xb9 ? 'y' : 'x';
+			if (_dispatch == 2 && _dispatch_reg == reg) _dispatch_lo = _arg, _dispatch = 3;
+			else _dispatch_hi = _arg, _dispatch_reg = reg, _dispatch = 1;
+			return;
+		}
+
+		case 0x48: // pha
+			if (_dispatch == 1 || _dispatch == 3) ++_dispatch;
+			else _dispatch = 0;
+			return;
+
+		case 0x60: // rts
+			if (_dispatch == 4) push(_dispatch_lo, _dispatch_hi, _scaled ? -1 : count(_dispatch_reg));
+			break;
+
+		default:
+			// other branches and calls leave the count unknown.
+			if (disassembler::branchlike(_op) || _op == 0x20 || _op == 0x22) _limit = -1;
+			break;
 	}
-	reset();
+
+	_dispatch = 0;
+	if (disassembler::terminal(_op)) _limit = -1;
 }
@@ -2,9 +2,89 @@
 #define __disassembler_h__
 
 #include <stdint.h>
+#include <stdio.h>
+#include <bitset>
 #include <string>
+#include <tuple>
+#include <utility>
 #include <vector>
 
+#include "inline_params.h"
+#include "line_index.h"
+
+// address modes (low nybble is the base operand size)
+
+static constexpr const int mImplied =      0x0000;
+static constexpr const int mImmediate =    0x1000;
+static constexpr const int mAbsolute =     0x2000;
+static constexpr const int mAbsoluteI =    0x3000;
+static constexpr const int mAbsoluteIL =   0x4000;
+static constexpr const int mAbsoluteLong = 0x5000;
+static constexpr const int mDP =           0x6000;
+static constexpr const int mDPI =          0x7000;
+static constexpr const int mDPIL =         0x8000;
+static constexpr const int mRelative =     0x9000;
+static constexpr const int mBlockMove =    0xa000;
+static constexpr const int mImpliedA =     0xb000; // inc a, dec a, etc.
+
+static constexpr const int m_S =          0x0100;
+static constexpr const int m_X =          0x0200;
+static constexpr const int m_Y =          0x0400;
+
+static constexpr const int m_M =          0x0020;
+static constexpr const int m_I =          0x0010;
+
+
+
+// decode events.  They're batched and delivered once per block (at
+// each label, branch and flush), so observers see whole blocks and
+// nothing is recorded when there are no observers.
+struct decode_event {
+	enum : uint8_t {
+		instruction, // op, arg, size = operand bytes, flags = m/x
+		label,
+		section, // new pc or code/data switch.  arg = 1 for code
+		data, // size bytes, arg = the first 4
+		space, // size bytes of arg (ds)
+	};
+
+	uint8_t kind;
+	uint8_t op;
+	uint8_t flags;
+	uint32_t pc;
+	uint32_t arg;
+	uint32_t size;
+};
+
+class decode_observer {
+public:
+	virtual ~decode_observer() = default;
+	virtual void events(const decode_event *begin, const decode_event *end) = 0;
+};
+
+// observers known at compile time.  One virtual call per block, then
+// direct (inlinable) calls to each observer's events().
+template<class... Observers>
+class static_observers final : public decode_observer {
+public:
+	static_observers(Observers &... o) : _observers(o...)
+	{}
+
+	virtual void events(const decode_event *begin, const decode_event *end) override {
+		apply(begin, end, std::index_sequence_for<Observers...>());
+	}
+
+private:
+	template<size_t... I>
+	void apply(const decode_event *begin, const decode_event *end, std::index_sequence<I...>) {
+		int unused[] = { 0, (std::get<I>(_observers).events(begin, end), 0)... };
+		(void)unused;
+	}
+
+	std::tuple<Observers &...> _observers;
+};
+
+
 // disassembler traits
 
 class disassembler {
@@ -25,10 +105,16 @@ class disassembler {
 			bit_hacks = 32,
 			// mvn $010000,$020000 vs mvn $01,$02
 			block_move_high = 64,
+			// a:xxxx, z:xx, f:xxxxxx vs |xxxx, <xx, >xxxxxx
+			ca65_size_prefix = 128,
+			// xxxx, xx vs |xxxx, <xx
+			no_size_prefix = 256,
 
 			orca = jml_indirect_modifier | explicit_implied_a | block_move_high,
 			mpw = jml_indirect_modifier | explicit_implied_a | block_move_high,
 			wdc = pea_immediate,
+			merlin = no_size_prefix,
+			ca65 = ca65_size_prefix,
 		};
 
 	
@@ -37,6 +123,11 @@ class disassembler {
 		{}
 		virtual ~disassembler();
 
+		// start over (for another module) without giving up any
+		// allocations.  Traits are kept; observers are dropped.
+		void reset();
+		void set_traits(unsigned traits) { _traits = traits; }
+
 		void operator()(uint8_t byte);
 		void operator()(const std::string &expr, unsigned size, uint32_t value = 0);
 
@@ -46,7 +137,19 @@ class disassembler {
 		template<class T>
 		void operator()(const T &t) { (*this)(std::begin(t), std::end(t)); }
 
-		void space(unsigned bytes);
+		void space(unsigned bytes) { fill(bytes, 0); }
+		// bytes copies of value, as ds (or the dialect's fill).
+		void fill(unsigned bytes, uint8_t value);
+
+		// data bytes in bulk.  Same listing as one byte at a time,
+		// but whole lines are formatted straight from the source and
+		// written once per run (or label).  Runs of a repeated byte
+		// become fills.  With stop, returns early at the first line
+		// starting at or after it; returns where it stopped.
+		const uint8_t *data(const uint8_t *begin, const uint8_t *end, const uint8_t *stop = nullptr);
+
+		// shortest run of a repeated byte that data() turns into a fill.
+		static constexpr const unsigned min_fill = 8;
 
 		bool m() const { return _flags & 0x20; }
 		bool x() const { return _flags & 0x10; }
@@ -62,10 +165,36 @@ class disassembler {
 		}
 
 		uint32_t pc() const { return _pc; }
-		void set_pc(uint32_t pc) { if (_pc != pc) { flush(); _pc = pc; } }
+		void set_pc(uint32_t pc) {
+			if (_pc != pc) {
+				flush();
+				_marks.clear();
+				_block = 0;
+				_pc = pc;
+				post(decode_event::section, 0, _code);
+			}
+		}
 
 		bool code() const { return _code; }
-		void set_code(bool code) { if (_code != code) { flush(); _code = code; } }
+		void set_code(bool code) {
+			if (_code != code) {
+				flush();
+				_code = code;
+				post(decode_event::section, 0, _code);
+			}
+			_layout = nullptr;
+			_inline_data = 0;
+		}
+
+		// observers must outlive the disassembler (or unsubscribe).
+		void subscribe(decode_observer *o) { _observers.push_back(o); }
+		void unsubscribe(decode_observer *o);
+
+		void set_inline_params(const inline_params *params) { _params = params; }
+
+		// cycle counts in the comment column, with block and loop totals.
+		void set_cpu(unsigned cpu) { _cpu = cpu; }
+		void set_direct_page(uint16_t dp) { _dp = dp; }
 
 		void flush();
 
@@ -76,12 +205,37 @@ class disassembler {
 
 		static std::string to_x(uint32_t value, unsigned bytes, char prefix = 0);
 
+		// listing output for the current thread (stdout by default).
+		// With an index, everything written through write() is counted
+		// and mark_line() records where the next line starts.
+		static FILE *output() { return _output ? _output : stdout; }
+		static void set_output(FILE *file, line_index *index = nullptr) { _output = file; _index = index; }
+
+		static void write(const char *s, size_t size) {
+			fwrite(s, 1, size, output());
+			if (_index) _index->advance(s, size);
+		}
+		static void write(const std::string &s) { write(s.data(), s.size()); }
+		static void mark_line(uint32_t address) { if (_index) _index->mark(address); }
+
 		static void emit(const std::string &label);
 		static void emit(const std::string &label, const std::string &opcode);
 		static void emit(const std::string &label, const std::string &opcode, const std::string &operand);
 		static void emit(const std::string &label, const std::string &opcode, const std::string &operand, const std::string &comment);
 
 		static int operand_size(uint8_t op, bool m = true, bool x = true);
+		static unsigned operand_mode(uint8_t op);
+		static bool branchlike(uint8_t op);
+		static bool terminal(uint8_t op);
+
+		// operand decoration for an address mode, eg "(<" and "),y".
+		static std::string prefix(unsigned mode, unsigned size, unsigned traits = 0);
+		static std::string suffix(unsigned mode);
+		static std::string mnemonic(uint8_t op);
+
+		// 24-bit targets of relative and absolute operands at pc.
+		static uint32_t relative_address(uint32_t pc, unsigned size, uint32_t arg);
+		static uint32_t absolute_address(uint32_t pc, uint8_t op, unsigned size, uint32_t arg);
 
 	protected:
 
@@ -94,6 +248,10 @@ class disassembler {
 
 
 		virtual std::string ds() const { return "ds"; }
+		// non-zero fills.  opcode, operand.
+		virtual std::pair<std::string, std::string> format_fill(unsigned count, uint8_t value) {
+			return std::make_pair(ds(), std::to_string(count) + "," + to_x(value, 2, '$'));
+		}
 
 
 		void set_inline_data(int count) {
@@ -106,12 +264,17 @@ class disassembler {
 			return -1;
 		}
 
+		// the first label after address (eg, the end of a table), or -1.
+		virtual int32_t label_after(uint32_t address) {
+			return -1;
+		}
+
 		virtual void event(uint8_t opcode, uint32_t operand) {}
 
 
 	private:
 
-		void reset();
+		void next_instruction();
 
 		void dump();
 		void dump(const std::string &expr, unsigned size, uint32_t value = 0);
@@ -119,10 +282,28 @@ class disassembler {
 		void print();
 		void print(const std::string &expr);
 
-		std::string prefix();
-		std::string suffix();
+		std::string prefix() const { return prefix(_mode, _size, _traits); }
+		std::string suffix() const { return suffix(_mode); }
 
-		void hexdump(std::string &);
+		void hexdump(std::string &line) { hexdump(line, _pc, _bytes, _st, _traits); }
+		static void hexdump(std::string &line, uint32_t pc, const uint8_t *data, unsigned size, unsigned traits);
+		void inline_field(uint8_t byte);
+
+		void timing(std::string &);
+		void end_block();
+
+		void post(uint8_t kind, uint8_t op, uint32_t arg, uint32_t size = 0) {
+			if (_observers.empty()) return;
+			_events.push_back(decode_event{ kind, op, (uint8_t)(_flags & 0x30), _pc, arg, size });
+		}
+		void deliver();
+
+		// little endian _bytes[first, first + count)
+		uint32_t bytes(unsigned first, unsigned count) const {
+			uint32_t rv = 0;
+			for (unsigned i = 0; i < count && first + i < 4; ++i) rv |= _bytes[first + i] << (8 * i);
+			return rv;
+		}
 
 		unsigned _st = 0;
 		uint8_t _op = 0;
@@ -135,11 +316,37 @@ class disassembler {
 
 		bool _code = true;
 		int _inline_data = 0;
-		int _prodos_mli = 0;
 		int32_t _next_label = -1;
 
+		const inline_params *_params = &inline_params::standard();
+		const char *_layout = nullptr;
+
 		unsigned _traits = 0;
 
+		unsigned _cpu = 0;
+		uint16_t _dp = 0;
+
+		// straight line cycle totals, before each instruction since
+		// the last pc change.  pages is the number with a possible
+		// page crossing penalty.
+		struct mark {
+			uint32_t pc;
+			unsigned cycles;
+			unsigned pages;
+		};
+		std::vector<mark> _marks;
+		unsigned _cycles = 0;
+		unsigned _pages = 0;
+		size_t _block = 0; // first mark in the current block.
+		unsigned _taken = 0; // taken branch at the end of the block.
+		std::string _loop;
+
+		std::vector<decode_observer *> _observers;
+		std::vector<decode_event> _events;
+
+		static thread_local FILE *_output;
+		static thread_local line_index *_index;
+
 		void check_labels();
 };
 
@@ -153,6 +360,11 @@ public:
 	void set_pc(uint32_t pc) { _pc = pc; }
 	uint32_t pc() const { return _pc; }
 
+	// start over, keeping the traits, inline params and allocations.
+	void reset();
+
+	void set_inline_params(const inline_params *params) { _params = params; }
+
 
 	bool m() const { return _flags & 0x20; }
 	bool x() const { return _flags & 0x10; }
@@ -173,7 +385,25 @@ public:
 	void operator()(uint32_t x, unsigned size);
 
 
+	// jmp (abs), jmp/jsr (abs,x) and pha/pha/rts dispatch tables.
+	// hi is set for split lo/hi byte tables (which hold target - 1).
+	// count is 0 if the size couldn't be determined.
+	struct table {
+		uint32_t address;
+		uint32_t hi;
+		unsigned count;
+	};
+
 	const std::vector<uint32_t> &finish();
+	const std::vector<table> &tables() const { return _tables; }
+
+	// jsr, jmp and branch targets (also in the labels).
+	const std::vector<uint32_t> &calls() const { return _calls; }
+
+	// direct page bytes used by dp, (dp) and [dp] operands.  Indexed
+	// operands count as their base address.
+	const std::bitset<256> &dp_reads() const { return _dp_reads; }
+	const std::bitset<256> &dp_writes() const { return _dp_writes; }
 
 	bool state() const { return _st == 0; }
 	unsigned op() const { return _op; }
@@ -181,11 +411,12 @@ public:
 
 private:
 
-	void reset();
+	void advance();
 	void process();
+	void find_tables();
+	void direct_page();
 
 	unsigned _traits = 0;
-	int _inline_data = 0;
 	bool _code = true;
 	unsigned _st = 0;
 	uint8_t _op = 0;
@@ -194,9 +425,37 @@ private:
 	unsigned _pc = 0;
 	unsigned _arg = 0;
 	unsigned _mode = 0;
-	int _prodos_mli = 0;
+
+	const inline_params *_params = &inline_params::standard();
+	const char *_layout = nullptr;
+	unsigned _inline_st = 0;
+
+	// table size from a preceding compare.  _limit_reg is the index
+	// register it applies to ('a' until a cmp is followed by tax).
+	int _limit = -1;
+	char _limit_reg = 0;
+	bool _scaled = false;
+	unsigned _limit_st = 0;
+	uint32_t _limit_pc = 0;
+	unsigned _dispatch = 0;
+	char _dispatch_reg = 0;
+	uint32_t _dispatch_lo = 0;
+	uint32_t _dispatch_hi = 0;
+
+	// compare ... jump spans; a label inside one voids the count.
+	struct span {
+		size_t table;
+		uint32_t begin;
+		uint32_t end;
+	};
 
 	std::vector<uint32_t> _labels;
+	std::vector<uint32_t> _calls;
+	std::vector<table> _tables;
+	std::vector<span> _spans;
+
+	std::bitset<256> _dp_reads;
+	std::bitset<256> _dp_writes;
 };
 
 #endif
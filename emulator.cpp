@@ -0,0 +1,474 @@
+#include "emulator.h"
+#include "disassembler.h"
+
+#include <algorithm>
+#include <string.h>
+
+enum {
+	C = 0x01,
+	Z = 0x02,
+	I = 0x04,
+	D = 0x08,
+	B = 0x10,
+	V = 0x40,
+	N = 0x80,
+};
+
+// per-path limit so jmp * (etc) can't eat the whole budget.
+static constexpr const unsigned kPathLimit = 0x10000;
+
+
+emulator::emulator(const uint8_t *data, uint32_t size, uint32_t org) :
+	_size(size), _org(org), _memory(0x10000), _code(0x10000 / 64), _queued(0x10000 / 64)
+{
+	size = std::min<uint32_t>(size, 0x10000 - org);
+	memcpy(_memory.data() + org, data, size);
+}
+
+void emulator::add_entry(uint32_t pc, uint8_t a) {
+	state s;
+	s.pc = pc;
+	s.a = a;
+	_pending.push_back(s);
+}
+
+void emulator::fork(const state &s, uint16_t pc) {
+	if (!in_module(pc) || executed(pc) || queued(pc)) return;
+
+	_queued[pc >> 6] |= UINT64_C(1) << (pc & 63);
+
+	state tmp = s;
+	tmp.pc = pc;
+	_pending.push_back(tmp);
+}
+
+const std::vector<uint32_t> &emulator::targets() {
+	std::sort(_targets.begin(), _targets.end());
+	_targets.erase(std::unique(_targets.begin(), _targets.end()), _targets.end());
+	return _targets;
+}
+
+std::vector<std::pair<uint32_t, uint32_t>> emulator::runs(uint32_t begin, uint32_t end) const {
+
+	std::vector<std::pair<uint32_t, uint32_t>> rv;
+
+	end = std::min<uint32_t>(end, 0x10000);
+	for (uint32_t pc = begin; pc < end; ) {
+		if (!executed(pc)) { ++pc; continue; }
+		uint32_t first = pc;
+		while (pc < end && executed(pc)) ++pc;
+		rv.emplace_back(first, pc);
+	}
+	return rv;
+}
+
+uint64_t emulator::run(uint64_t budget) {
+
+	uint64_t count = 0;
+
+	while (!_pending.empty() && count < budget) {
+		state s = _pending.back();
+		_pending.pop_back();
+
+		target(s.pc);
+		for (unsigned i = 0; i < kPathLimit && count < budget; ++i) {
+			++count;
+			if (!step(s)) break;
+		}
+	}
+	return count;
+}
+
+
+static inline uint8_t nz(uint8_t p, uint8_t value) {
+	p &= ~(N | Z);
+	if (!value) p |= Z;
+	return p | (value & N);
+}
+
+static inline uint8_t adc(uint8_t &p, uint8_t a, uint8_t value) {
+	unsigned carry = p & C;
+	unsigned rv;
+
+	if (p & D) {
+		unsigned lo = (a & 0x0f) + (value & 0x0f) + carry;
+		unsigned hi = (a & 0xf0) + (value & 0xf0);
+		if (lo > 0x09) { lo += 0x06; hi += 0x10; }
+		if (hi > 0x90) hi += 0x60;
+		rv = (hi & 0xf0) | (lo & 0x0f);
+		p &= ~(C | V);
+		if (hi > 0xff) p |= C;
+	} else {
+		rv = a + value + carry;
+		p &= ~(C | V);
+		if (rv > 0xff) p |= C;
+		if (~(a ^ value) & (a ^ rv) & 0x80) p |= V;
+	}
+	p = nz(p, rv);
+	return rv;
+}
+
+static inline uint8_t sbc(uint8_t &p, uint8_t a, uint8_t value) {
+	if (!(p & D)) return adc(p, a, ~value);
+
+	unsigned borrow = ~p & C;
+	int lo = (a & 0x0f) - (value & 0x0f) - borrow;
+	int hi = (a & 0xf0) - (value & 0xf0);
+	if (lo < 0) { lo -= 0x06; hi -= 0x10; }
+	if (hi < 0) hi -= 0x60;
+	p &= ~(C | V);
+	if (a >= value + borrow) p |= C;
+	uint8_t rv = (hi & 0xf0) | (lo & 0x0f);
+	p = nz(p, rv);
+	return rv;
+}
+
+static inline uint8_t cmp(uint8_t p, uint8_t reg, uint8_t value) {
+	p = nz(p, reg - value);
+	if (reg >= value) p |= C;
+	else p &= ~C;
+	return p;
+}
+
+
+bool emulator::step(state &s) {
+
+	uint16_t pc = s.pc;
+	if (!in_module(pc)) return false;
+
+	uint8_t op = _memory[pc];
+	unsigned mode = disassembler::operand_mode(op);
+	unsigned size = disassembler::operand_size(op, false, false);
+
+	uint16_t arg = 0;
+	for (unsigned i = 0; i < size; ++i)
+		arg |= _memory[(uint16_t)(pc + 1 + i)] << (i * 8);
+
+	uint16_t next = pc + 1 + size;
+	uint16_t ea = 0;
+
+	mark(pc, 1 + size);
+
+	// effective address, straight from the mode table.
+	switch(mode & 0xf000) {
+		case mAbsolute:
+			ea = arg;
+			if (mode & m_X) ea += s.x;
+			if (mode & m_Y) ea += s.y;
+			break;
+		case mDP:
+			if (mode & m_S) return false;
+			ea = arg;
+			if (mode & m_X) ea = (uint8_t)(arg + s.x);
+			if (mode & m_Y) ea = (uint8_t)(arg + s.y);
+			break;
+		case mDPI:
+			if (mode & m_S) return false;
+			if (mode & m_X) ea = read_16_zp(arg + s.x);
+			else ea = read_16_zp(arg);
+			if (mode & m_Y) ea += s.y;
+			break;
+
+		// 65816 only.
+		case mAbsoluteIL:
+		case mAbsoluteLong:
+		case mDPIL:
+		case mBlockMove:
+			return false;
+	}
+
+	auto value = [&]() -> uint8_t {
+		if ((mode & 0xf000) == mImmediate) return arg;
+		return read(ea);
+	};
+
+	// read-modify-write on a or memory.
+	auto rmw = [&](uint8_t (*f)(uint8_t &, uint8_t)) {
+		switch(op) {
+			case 0x0a: case 0x1a: case 0x2a: case 0x3a: case 0x4a: case 0x6a:
+				s.a = f(s.p, s.a);
+				break;
+			default:
+				write(ea, f(s.p, read(ea)));
+				break;
+		}
+	};
+
+	auto push = [&](uint8_t x) {
+		_memory[0x0100 | s.s] = x;
+		--s.s;
+	};
+	auto pull = [&]() -> uint8_t {
+		++s.s;
+		return _memory[0x0100 | s.s];
+	};
+
+	// rts back to the (stubbed) caller ends the path.
+	auto rts = [&]() -> bool {
+		if (s.s >= 0xfe) return false;
+		uint16_t tmp = pull();
+		tmp |= pull() << 8;
+		s.pc = tmp + 1;
+		return true;
+	};
+
+	auto jump = [&](uint16_t address) -> bool {
+		if (!in_module(address)) return rts();
+		target(address);
+		s.pc = address;
+		return true;
+	};
+
+	auto branch = [&](bool taken) -> bool {
+		uint16_t address = next + (int8_t)arg;
+		target(address);
+		fork(s, taken ? next : address);
+		s.pc = taken ? address : next;
+		// both ways already explored (or queued).
+		if ((executed(address) || queued(address)) && (executed(next) || queued(next)))
+			return false;
+		return in_module(s.pc);
+	};
+
+	s.pc = next;
+
+	switch(op) {
+
+		// ora
+		case 0x01: case 0x05: case 0x09: case 0x0d:
+		case 0x11: case 0x12: case 0x15: case 0x19: case 0x1d:
+			s.a |= value();
+			s.p = nz(s.p, s.a);
+			break;
+
+		// and
+		case 0x21: case 0x25: case 0x29: case 0x2d:
+		case 0x31: case 0x32: case 0x35: case 0x39: case 0x3d:
+			s.a &= value();
+			s.p = nz(s.p, s.a);
+			break;
+
+		// eor
+		case 0x41: case 0x45: case 0x49: case 0x4d:
+		case 0x51: case 0x52: case 0x55: case 0x59: case 0x5d:
+			s.a ^= value();
+			s.p = nz(s.p, s.a);
+			break;
+
+		// adc
+		case 0x61: case 0x65: case 0x69: case 0x6d:
+		case 0x71: case 0x72: case 0x75: case 0x79: case 0x7d:
+			s.a = adc(s.p, s.a, value());
+			break;
+
+		// sbc
+		case 0xe1: case 0xe5: case 0xe9: case 0xed:
+		case 0xf1: case 0xf2: case 0xf5: case 0xf9: case 0xfd:
+			s.a = sbc(s.p, s.a, value());
+			break;
+
+		// cmp
+		case 0xc1: case 0xc5: case 0xc9: case 0xcd:
+		case 0xd1: case 0xd2: case 0xd5: case 0xd9: case 0xdd:
+			s.p = cmp(s.p, s.a, value());
+			break;
+
+		case 0xe0: case 0xe4: case 0xec: // cpx
+			s.p = cmp(s.p, s.x, value());
+			break;
+
+		case 0xc0: case 0xc4: case 0xcc: // cpy
+			s.p = cmp(s.p, s.y, value());
+			break;
+
+		// lda
+		case 0xa1: case 0xa5: case 0xa9: case 0xad:
+		case 0xb1: case 0xb2: case 0xb5: case 0xb9: case 0xbd:
+			s.a = value();
+			s.p = nz(s.p, s.a);
+			break;
+
+		case 0xa2: case 0xa6: case 0xae: case 0xb6: case 0xbe: // ldx
+			s.x = value();
+			s.p = nz(s.p, s.x);
+			break;
+
+		case 0xa0: case 0xa4: case 0xac: case 0xb4: case 0xbc: // ldy
+			s.y = value();
+			s.p = nz(s.p, s.y);
+			break;
+
+		// sta
+		case 0x81: case 0x85: case 0x8d:
+		case 0x91: case 0x92: case 0x95: case 0x99: case 0x9d:
+			write(ea, s.a);
+			break;
+
+		case 0x86: case 0x8e: case 0x96: write(ea, s.x); break; // stx
+		case 0x84: case 0x8c: case 0x94: write(ea, s.y); break; // sty
+		case 0x64: case 0x74: case 0x9c: case 0x9e: write(ea, 0); break; // stz
+
+		// bit
+		case 0x24: case 0x2c: case 0x34: case 0x3c: {
+			uint8_t tmp = value();
+			s.p &= ~(N | V | Z);
+			s.p |= tmp & (N | V);
+			if (!(tmp & s.a)) s.p |= Z;
+			break;
+		}
+		case 0x89: // bit #
+			s.p &= ~Z;
+			if (!(arg & s.a)) s.p |= Z;
+			break;
+
+		case 0x04: case 0x0c: { // tsb
+			uint8_t tmp = read(ea);
+			s.p &= ~Z;
+			if (!(tmp & s.a)) s.p |= Z;
+			write(ea, tmp | s.a);
+			break;
+		}
+		case 0x14: case 0x1c: { // trb
+			uint8_t tmp = read(ea);
+			s.p &= ~Z;
+			if (!(tmp & s.a)) s.p |= Z;
+			write(ea, tmp & ~s.a);
+			break;
+		}
+
+		case 0x06: case 0x0a: case 0x0e: case 0x16: case 0x1e: // asl
+			rmw([](uint8_t &p, uint8_t x) -> uint8_t {
+				p = (p & ~C) | (x >> 7);
+				x <<= 1;
+				p = nz(p, x);
+				return x;
+			});
+			break;
+
+		case 0x26: case 0x2a: case 0x2e: case 0x36: case 0x3e: // rol
+			rmw([](uint8_t &p, uint8_t x) -> uint8_t {
+				uint8_t c = p & C;
+				p = (p & ~C) | (x >> 7);
+				x = (x << 1) | c;
+				p = nz(p, x);
+				return x;
+			});
+			break;
+
+		case 0x46: case 0x4a: case 0x4e: case 0x56: case 0x5e: // lsr
+			rmw([](uint8_t &p, uint8_t x) -> uint8_t {
+				p = (p & ~C) | (x & C);
+				x >>= 1;
+				p = nz(p, x);
+				return x;
+			});
+			break;
+
+		case 0x66: case 0x6a: case 0x6e: case 0x76: case 0x7e: // ror
+			rmw([](uint8_t &p, uint8_t x) -> uint8_t {
+				uint8_t c = p & C;
+				p = (p & ~C) | (x & C);
+				x = (x >> 1) | (c << 7);
+				p = nz(p, x);
+				return x;
+			});
+			break;
+
+		case 0x1a: case 0xe6: case 0xee: case 0xf6: case 0xfe: // inc
+			rmw([](uint8_t &p, uint8_t x) -> uint8_t {
+				++x;
+				p = nz(p, x);
+				return x;
+			});
+			break;
+
+		case 0x3a: case 0xc6: case 0xce: case 0xd6: case 0xde: // dec
+			rmw([](uint8_t &p, uint8_t x) -> uint8_t {
+				--x;
+				p = nz(p, x);
+				return x;
+			});
+			break;
+
+		case 0xe8: ++s.x; s.p = nz(s.p, s.x); break; // inx
+		case 0xca: --s.x; s.p = nz(s.p, s.x); break; // dex
+		case 0xc8: ++s.y; s.p = nz(s.p, s.y); break; // iny
+		case 0x88: --s.y; s.p = nz(s.p, s.y); break; // dey
+
+		case 0xaa: s.x = s.a; s.p = nz(s.p, s.x); break; // tax
+		case 0xa8: s.y = s.a; s.p = nz(s.p, s.y); break; // tay
+		case 0x8a: s.a = s.x; s.p = nz(s.p, s.a); break; // txa
+		case 0x98: s.a = s.y; s.p = nz(s.p, s.a); break; // tya
+		case 0xba: s.x = s.s; s.p = nz(s.p, s.x); break; // tsx
+		case 0x9a: s.s = s.x; break; // txs
+
+		case 0x48: push(s.a); break; // pha
+		case 0xda: push(s.x); break; // phx
+		case 0x5a: push(s.y); break; // phy
+		case 0x08: push(s.p | B | 0x20); break; // php
+		case 0x68: s.a = pull(); s.p = nz(s.p, s.a); break; // pla
+		case 0xfa: s.x = pull(); s.p = nz(s.p, s.x); break; // plx
+		case 0x7a: s.y = pull(); s.p = nz(s.p, s.y); break; // ply
+		case 0x28: s.p = pull(); break; // plp
+
+		case 0x18: s.p &= ~C; break; // clc
+		case 0x38: s.p |= C; break; // sec
+		case 0x58: s.p &= ~I; break; // cli
+		case 0x78: s.p |= I; break; // sei
+		case 0xb8: s.p &= ~V; break; // clv
+		case 0xd8: s.p &= ~D; break; // cld
+		case 0xf8: s.p |= D; break; // sed
+
+		case 0xea: break; // nop
+
+		case 0x10: return branch(!(s.p & N)); // bpl
+		case 0x30: return branch(s.p & N); // bmi
+		case 0x50: return branch(!(s.p & V)); // bvc
+		case 0x70: return branch(s.p & V); // bvs
+		case 0x90: return branch(!(s.p & C)); // bcc
+		case 0xb0: return branch(s.p & C); // bcs
+		case 0xd0: return branch(!(s.p & Z)); // bne
+		case 0xf0: return branch(s.p & Z); // beq
+		case 0x80: // bra
+			return jump(next + (int8_t)arg);
+
+		case 0x4c: return jump(arg); // jmp
+		case 0x6c: return jump(read_16(arg)); // jmp (abs)
+		case 0x7c: return jump(read_16(arg + s.x)); // jmp (abs,x)
+
+		case 0x20: // jsr
+			if (!in_module(arg)) {
+				// stubbed.  skip any inline parameters.
+				unsigned n = _params->length(arg, _memory.data() + next, _memory.data() + _memory.size());
+				if (n) {
+					mark(next, n);
+					s.pc = next + n;
+				}
+				// prodos mli returns a = 0, carry clear.
+				if (arg == 0xbf00) {
+					s.a = 0;
+					s.p = nz(s.p & ~C, 0);
+				}
+				break;
+			}
+			push((next - 1) >> 8);
+			push(next - 1);
+			return jump(arg);
+
+		case 0xfc: { // jsr (abs,x)
+			uint16_t address = read_16(arg + s.x);
+			if (!in_module(address)) break;
+			push((next - 1) >> 8);
+			push(next - 1);
+			return jump(address);
+		}
+
+		case 0x60: return rts();
+
+		// brk, rti, wai, stp, and everything 65816.
+		default:
+			return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,100 @@
+#ifndef __emulator_h__
+#define __emulator_h__
+
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+#include "inline_params.h"
+
+// 65c02 interpreter for code discovery.
+// The module runs in a stubbed apple ii:  calls outside the module
+// (rom, mli, ommvec) return immediately, $c0xx reads return 0
+// and rom/io writes are ignored.  Conditional branches fork so both
+// directions are explored.  Executed bytes are recorded in a bitmap.
+
+class emulator {
+
+public:
+
+	emulator(const uint8_t *data, uint32_t size, uint32_t org);
+
+	void add_entry(uint32_t pc, uint8_t a = 0);
+
+	void set_inline_params(const inline_params *params) { _params = params; }
+
+	// returns the number of instructions executed.
+	uint64_t run(uint64_t budget = 1000000);
+
+	bool executed(uint32_t address) const {
+		return _code[address >> 6] & (UINT64_C(1) << (address & 63));
+	}
+
+	bool queued(uint32_t address) const {
+		return _queued[address >> 6] & (UINT64_C(1) << (address & 63));
+	}
+
+	// [begin, end) runs of executed bytes.
+	std::vector<std::pair<uint32_t, uint32_t>> runs(uint32_t begin, uint32_t end) const;
+
+	// jsr/jmp/branch targets inside the module, sorted.
+	const std::vector<uint32_t> &targets();
+
+private:
+
+	struct state {
+		uint16_t pc = 0;
+		uint8_t a = 0;
+		uint8_t x = 0;
+		uint8_t y = 0;
+		uint8_t s = 0xff;
+		uint8_t p = 0x34;
+	};
+
+	bool step(state &s);
+
+	bool in_module(uint32_t address) const {
+		return address >= _org && address < _org + _size;
+	}
+
+	uint8_t read(uint16_t address) const {
+		if ((address & 0xff00) == 0xc000) return 0;
+		return _memory[address];
+	}
+
+	void write(uint16_t address, uint8_t value) {
+		if (address >= 0xc000) return;
+		_memory[address] = value;
+	}
+
+	uint16_t read_16(uint16_t address) const {
+		return read(address) | (read(address + 1) << 8);
+	}
+
+	uint16_t read_16_zp(uint8_t address) const {
+		return read(address) | (read((uint8_t)(address + 1)) << 8);
+	}
+
+	void mark(uint32_t address, unsigned size) {
+		for (unsigned i = 0; i < size; ++i, ++address) {
+			address &= 0xffff;
+			_code[address >> 6] |= UINT64_C(1) << (address & 63);
+		}
+	}
+
+	void fork(const state &s, uint16_t pc);
+	void target(uint16_t pc) { if (in_module(pc)) _targets.push_back(pc); }
+
+	uint32_t _size;
+	uint32_t _org;
+
+	const inline_params *_params = &inline_params::standard();
+
+	std::vector<uint8_t> _memory;
+	std::vector<uint64_t> _code;
+	std::vector<uint64_t> _queued;
+	std::vector<state> _pending;
+	std::vector<uint32_t> _targets;
+};
+
+#endif
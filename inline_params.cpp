@@ -0,0 +1,126 @@
+#include "inline_params.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <err.h>
+
+#include <algorithm>
+
+
+inline_params::inline_params() : _index(0x10000) {
+	// prodos mli:  command (byte), parameter list (pointer)
+	add(0xbf00, "bp");
+}
+
+inline_params &inline_params::standard() {
+	static inline_params params;
+	return params;
+}
+
+bool inline_params::valid(const std::string &layout) {
+	if (layout.empty()) return false;
+	return std::all_of(layout.begin(), layout.end(), [](char c){
+		return c == 'b' || c == 'w' || c == 'p' || c == 'z' || c == 'h';
+	});
+}
+
+bool inline_params::add(uint32_t address, const std::string &layout) {
+
+	if (address > 0xffff || !valid(layout)) return false;
+
+	unsigned i = _index[address];
+	if (i) {
+		_layouts[i - 1] = layout;
+		return true;
+	}
+	if (_layouts.size() >= 0xffff) return false;
+
+	_layouts.push_back(layout);
+	_index[address] = _layouts.size();
+	return true;
+}
+
+unsigned inline_params::length(uint32_t address, const uint8_t *begin, const uint8_t *end) const {
+
+	const char *layout = find(address);
+	if (!layout) return 0;
+
+	auto iter = begin;
+	for ( ; *layout && iter < end; ++layout) {
+		switch(*layout) {
+			case 'b': iter += 1; break;
+			case 'w':
+			case 'p': iter += 2; break;
+			case 'z':
+				while (iter < end && *iter++ != 0) ;
+				break;
+			case 'h':
+				while (iter < end && !(*iter++ & 0x80)) ;
+				break;
+		}
+	}
+	return std::min(iter, end) - begin;
+}
+
+
+bool load_symbols(const std::string &path, inline_params &params,
+	std::vector<std::pair<unsigned, std::string>> &symbols) {
+
+	FILE *fp = fopen(path.c_str(), "r");
+	if (!fp) {
+		warn("%s", path.c_str());
+		return false;
+	}
+
+	char buffer[256];
+	unsigned line = 0;
+	bool ok = true;
+
+	while (fgets(buffer, sizeof(buffer), fp)) {
+		++line;
+
+		char *cp = strchr(buffer, ';');
+		if (cp) *cp = 0;
+
+		std::vector<std::string> tokens;
+		for (cp = strtok(buffer, " \t\r\n"); cp; cp = strtok(nullptr, " \t\r\n"))
+			tokens.emplace_back(cp);
+
+		if (tokens.empty()) continue;
+
+		if (tokens.size() < 2) {
+			warnx("%s:%u: missing address", path.c_str(), line);
+			ok = false;
+			continue;
+		}
+
+		const char *xp = tokens[1].c_str();
+		int base = 10;
+		if (*xp == '$') { ++xp; base = 16; }
+		else if (xp[0] == '0' && tolower(xp[1]) == 'x') { xp += 2; base = 16; }
+
+		char *end;
+		unsigned long address = strtoul(xp, &end, base);
+		if (!*xp || *end || address > 0xffff) {
+			warnx("%s:%u: bad address: %s", path.c_str(), line, tokens[1].c_str());
+			ok = false;
+			continue;
+		}
+
+		symbols.emplace_back(address, tokens[0]);
+
+		std::string layout;
+		for (unsigned i = 2; i < tokens.size(); ++i) layout += tokens[i];
+		if (layout.empty()) continue;
+
+		if (!params.add(address, layout)) {
+			warnx("%s:%u: bad layout: %s", path.c_str(), line, layout.c_str());
+			ok = false;
+		}
+	}
+
+	fclose(fp);
+	return ok;
+}
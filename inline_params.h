@@ -0,0 +1,55 @@
+#ifndef __inline_params_h__
+#define __inline_params_h__
+
+#include <stdint.h>
+#include <deque>
+#include <string>
+#include <utility>
+#include <vector>
+
+// subroutines that read parameters inline, after the jsr.
+// a layout is a string of fields:
+// b - byte
+// w - word
+// p - word pointer (labeled)
+// z - string, 0-terminated
+// h - string, terminated by a byte with the high bit set
+
+class inline_params {
+
+public:
+
+	inline_params();
+
+	// built-in (prodos mli) plus anything from the symbol file.
+	static inline_params &standard();
+
+	bool add(uint32_t address, const std::string &layout);
+
+	// layout for a jsr to address or nullptr.
+	const char *find(uint32_t address) const {
+		if (address > 0xffff) return nullptr;
+		unsigned i = _index[address];
+		return i ? _layouts[i - 1].c_str() : nullptr;
+	}
+
+	// number of inline bytes in [begin, end) following a jsr to address.
+	unsigned length(uint32_t address, const uint8_t *begin, const uint8_t *end) const;
+
+	static bool valid(const std::string &layout);
+
+private:
+
+	// direct-indexed by address; 0 = none, otherwise _layouts index + 1.
+	std::vector<uint16_t> _index;
+	std::deque<std::string> _layouts;
+};
+
+
+// symbol file:
+// ; comment
+// name    $address   [layout]
+bool load_symbols(const std::string &path, inline_params &params,
+	std::vector<std::pair<unsigned, std::string>> &symbols);
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef __label_table_h__
+#define __label_table_h__
+
+#include <stdint.h>
+#include <memory>
+#include <vector>
+
+// sparse 24-bit label bitmap.  Pages are allocated on first use
+// so a few scattered banks don't cost 16M bits.
+
+class label_table {
+
+public:
+
+	label_table() : _pages(1 << (24 - kPageBits))
+	{}
+
+	void set(uint32_t address) {
+		address &= 0xffffff;
+		auto &page = _pages[address >> kPageBits];
+		if (!page) page.reset(new uint64_t[kPageWords]());
+		unsigned bit = address & kPageMask;
+		page[bit >> 6] |= UINT64_C(1) << (bit & 63);
+	}
+
+	bool test(uint32_t address) const {
+		if (address > 0xffffff) return false;
+		const auto &page = _pages[address >> kPageBits];
+		if (!page) return false;
+		unsigned bit = address & kPageMask;
+		return page[bit >> 6] & (UINT64_C(1) << (bit & 63));
+	}
+
+	// first label >= address, -1 if none.
+	int32_t next(uint32_t address) const {
+		while (address <= 0xffffff) {
+			const auto &page = _pages[address >> kPageBits];
+			if (!page) {
+				address = (address | kPageMask) + 1;
+				continue;
+			}
+			unsigned bit = address & kPageMask;
+			uint64_t word = page[bit >> 6] & (~UINT64_C(0) << (bit & 63));
+			if (word) return (address & ~63) + __builtin_ctzll(word);
+			address = (address | 63) + 1;
+		}
+		return -1;
+	}
+
+private:
+
+	static constexpr const unsigned kPageBits = 12;
+	static constexpr const unsigned kPageMask = (1 << kPageBits) - 1;
+	static constexpr const unsigned kPageWords = (1 << kPageBits) / 64;
+
+	std::vector<std::unique_ptr<uint64_t[]>> _pages;
+};
+
+#endif
@@ -0,0 +1,111 @@
+#ifndef __le_view_h__
+#define __le_view_h__
+
+#include <stdint.h>
+#include <stddef.h>
+
+// little-endian views over (mapped) file data.  Nothing is copied.
+// Bounds are checked once per record -- has(n), take(n) -- and the
+// fields within are then read without further checks.
+
+class le_view {
+
+public:
+
+	le_view() = default;
+	le_view(const uint8_t *begin, const uint8_t *end) : _begin(begin), _end(end < begin ? begin : end)
+	{}
+	le_view(const uint8_t *data, size_t size) : _begin(data), _end(data + size)
+	{}
+
+	const uint8_t *begin() const { return _begin; }
+	const uint8_t *end() const { return _end; }
+	size_t size() const { return _end - _begin; }
+	bool empty() const { return _begin == _end; }
+
+	bool has(size_t n) const { return size() >= n; }
+	bool has(size_t offset, size_t n) const { return offset <= size() && size() - offset >= n; }
+
+	// unchecked field reads.
+	uint8_t u8(size_t offset) const { return _begin[offset]; }
+	uint16_t u16(size_t offset) const {
+		return _begin[offset] | (_begin[offset + 1] << 8);
+	}
+	uint32_t u24(size_t offset) const {
+		return u16(offset) | (_begin[offset + 2] << 16);
+	}
+	uint32_t u32(size_t offset) const {
+		return u16(offset) | ((uint32_t)u16(offset + 2) << 16);
+	}
+
+	// [offset, offset + n), clipped to the view.
+	le_view sub(size_t offset, size_t n = SIZE_MAX) const {
+		if (offset > size()) offset = size();
+		if (n > size() - offset) n = size() - offset;
+		return le_view(_begin + offset, n);
+	}
+
+private:
+	const uint8_t *_begin = nullptr;
+	const uint8_t *_end = nullptr;
+};
+
+
+class le_cursor {
+
+public:
+
+	le_cursor() = default;
+	le_cursor(const le_view &v) : _view(v), _iter(v.begin())
+	{}
+	le_cursor(const uint8_t *begin, const uint8_t *end) : le_cursor(le_view(begin, end))
+	{}
+
+	const uint8_t *position() const { return _iter; }
+	size_t offset() const { return _iter - _view.begin(); }
+	size_t remaining() const { return _view.end() - _iter; }
+	bool empty() const { return _iter == _view.end(); }
+
+	bool has(size_t n) const { return remaining() >= n; }
+
+	// consume n bytes as a view.  false (and nothing consumed) if short.
+	bool take(size_t n, le_view &out) {
+		if (!has(n)) return false;
+		out = le_view(_iter, n);
+		_iter += n;
+		return true;
+	}
+
+	bool skip(size_t n) {
+		if (!has(n)) return false;
+		_iter += n;
+		return true;
+	}
+
+	// checked reads.  false (and nothing consumed) at the end.
+	bool read(uint8_t &x) {
+		if (!has(1)) return false;
+		x = *_iter++;
+		return true;
+	}
+
+	bool read(uint16_t &x) {
+		if (!has(2)) return false;
+		x = le_view(_iter, 2).u16(0);
+		_iter += 2;
+		return true;
+	}
+
+	bool read(uint32_t &x) {
+		if (!has(4)) return false;
+		x = le_view(_iter, 4).u32(0);
+		_iter += 4;
+		return true;
+	}
+
+private:
+	le_view _view;
+	const uint8_t *_iter = nullptr;
+};
+
+#endif
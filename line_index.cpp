@@ -0,0 +1,61 @@
+#include "line_index.h"
+
+#include <err.h>
+#include <stdio.h>
+#include <algorithm>
+
+
+namespace {
+
+	constexpr const uint32_t kVersion = 1;
+	constexpr const uint32_t kEntrySize = 16;
+
+	void put32(std::vector<uint8_t> &v, uint32_t x) {
+		v.push_back(x);
+		v.push_back(x >> 8);
+		v.push_back(x >> 16);
+		v.push_back(x >> 24);
+	}
+}
+
+
+void line_index::append(const line_index &other) {
+	for (auto e : other._entries) {
+		e.line += _line;
+		e.offset += _offset;
+		_entries.push_back(e);
+	}
+	advance(other._offset, other._line);
+}
+
+
+bool line_index::write(const std::string &path) const {
+
+	// mostly in order already.
+	auto tmp = _entries;
+	std::stable_sort(tmp.begin(), tmp.end(), [](const entry &a, const entry &b){
+		return a.address < b.address;
+	});
+
+	std::vector<uint8_t> data = { 'O', 'M', 'M', 'I' };
+	data.reserve(16 + tmp.size() * kEntrySize);
+	put32(data, kVersion);
+	put32(data, tmp.size());
+	put32(data, kEntrySize);
+	for (const auto &e : tmp) {
+		put32(data, e.address);
+		put32(data, e.line);
+		put32(data, e.offset);
+		put32(data, e.offset >> 32);
+	}
+
+	FILE *f = fopen(path.c_str(), "wb");
+	if (!f) {
+		warn("%s", path.c_str());
+		return false;
+	}
+	bool ok = fwrite(data.data(), 1, data.size(), f) == data.size();
+	if (fclose(f) != 0) ok = false;
+	if (!ok) warn("%s", path.c_str());
+	return ok;
+}
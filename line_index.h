@@ -0,0 +1,62 @@
+#ifndef __line_index_h__
+#define __line_index_h__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+// sidecar index for a listing: the byte offset and line of the output
+// line for each pc and label, recorded while the listing is written.
+// The file is a sorted array of fixed size entries so a viewer can
+// mmap it and binary search.
+//
+// file, little endian:
+// "OMMI" version count entry_size
+// entries: address (32), line (32, from 1), offset (64).  Sorted by
+// address, then offset, so a label comes before its instruction.
+
+class line_index {
+
+public:
+
+	struct entry {
+		uint32_t address;
+		uint32_t line;
+		uint64_t offset;
+	};
+
+	// position of the next byte written.
+	uint64_t offset() const { return _offset; }
+	uint32_t line() const { return _line; }
+
+	void advance(const char *s, size_t size) {
+		_offset += size;
+		for (const char *end = s + size; (s = (const char *)memchr(s, '\n', end - s)); ++s) ++_line;
+	}
+
+	void advance(size_t size, uint32_t lines) {
+		_offset += size;
+		_line += lines;
+	}
+
+	// the line starting pending bytes (and lines) past the position.
+	void mark(uint32_t address, size_t pending = 0, uint32_t pending_lines = 0) {
+		_entries.push_back(entry{ address, _line + pending_lines + 1, _offset + pending });
+	}
+
+	// another listing (rendered separately) written at the position.
+	void append(const line_index &other);
+
+	const std::vector<entry> &entries() const { return _entries; }
+
+	bool write(const std::string &path) const;
+
+private:
+	uint64_t _offset = 0;
+	uint32_t _line = 0;
+	std::vector<entry> _entries;
+};
+
+#endif
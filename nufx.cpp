@@ -0,0 +1,283 @@
+#include "nufx.h"
+
+#include <string.h>
+#include <algorithm>
+
+namespace {
+
+	const uint8_t master_id[] = { 0x4e, 0xf5, 0x46, 0xe9, 0x6c, 0xe5 }; // NuFile
+	const uint8_t record_id[] = { 0x4e, 0xf5, 0x46, 0xd8 }; // NuFX
+
+	// through the archive when date.
+	constexpr const size_t kRecordHeader = 56;
+	constexpr const uint32_t kMaxLength = 16 * 1024 * 1024;
+
+	bool binary_ii(const le_view &v) {
+		return v.has(128) && v.u8(0) == 0x0a && v.u8(1) == 0x47 && v.u8(2) == 0x4c && v.u8(18) == 0x02;
+	}
+
+	// delim, c, n -> n + 1 c's.  Short chunks are 0-padded.
+	bool unrle(const uint8_t *in, unsigned n, uint8_t delim, uint8_t *out) {
+		unsigned j = 0;
+		for (unsigned i = 0; i < n; ) {
+			if (in[i] == delim) {
+				if (n - i < 3) return false;
+				unsigned count = in[i + 2] + 1;
+				if (4096 - j < count) return false;
+				memset(out + j, in[i + 1], count);
+				j += count;
+				i += 3;
+				continue;
+			}
+			if (j == 4096) return false;
+			out[j++] = in[i++];
+		}
+		memset(out + j, 0, 4096 - j);
+		return true;
+	}
+}
+
+
+bool nufx_archive::open(const uint8_t *data, size_t size, std::string &error) {
+
+	le_view v(data, size);
+	if (binary_ii(v)) v = v.sub(128);
+
+	_records.clear();
+	if (!v.has(48) || memcmp(v.begin(), master_id, sizeof(master_id))) return false;
+
+	uint32_t count = v.u32(8);
+	le_cursor c(v.sub(48));
+	for (uint32_t i = 0; i < count; ++i) {
+		if (!parse(c, error)) return false;
+	}
+	return true;
+}
+
+
+bool nufx_archive::parse(le_cursor &c, std::string &error) {
+
+	le_view v(c.position(), c.position() + c.remaining());
+
+	if (!v.has(kRecordHeader + 2) || memcmp(v.begin(), record_id, sizeof(record_id))) {
+		error = "bad record header";
+		return false;
+	}
+
+	record r;
+	unsigned attributes = v.u16(6);
+	uint32_t threads = v.u32(10);
+	r.file_type = v.u32(22);
+	r.aux_type = v.u32(26);
+
+	// the filename length follows the attributes.
+	if (attributes < kRecordHeader || !v.has(attributes, 2)) {
+		error = "bad record header";
+		return false;
+	}
+	unsigned name_length = v.u16(attributes);
+	size_t header = attributes + 2 + name_length;
+	if (!v.has(header) || !v.has(header, threads * UINT64_C(16))) {
+		error = "truncated record";
+		return false;
+	}
+	r.name.assign((const char *)v.begin() + attributes + 2, name_length);
+
+	le_view th;
+	c.skip(header);
+	c.take(threads * 16, th);
+
+	bool fork = false;
+	for (uint32_t i = 0; i < threads; ++i) {
+		unsigned type = th.u16(i * 16) << 16 | th.u16(i * 16 + 4); // class, kind
+		uint16_t format = th.u16(i * 16 + 2);
+		uint32_t length = th.u32(i * 16 + 8);
+		uint32_t compressed = th.u32(i * 16 + 12);
+
+		le_view data;
+		if (!c.take(compressed, data)) {
+			error = "truncated thread";
+			return false;
+		}
+
+		switch(type) {
+			case 0x00030000: // filename
+				r.name.assign((const char *)data.begin(), std::min<size_t>(length, data.size()));
+				break;
+			case 0x00020000: // data fork
+				r.data = data;
+				r.format = format;
+				r.length = length;
+				fork = true;
+				break;
+		}
+	}
+
+	if (fork) _records.emplace_back(std::move(r));
+	return true;
+}
+
+
+bool nufx_archive::expander::expand(const record &r, std::vector<uint8_t> &out, std::string &error) {
+
+	if (r.length > kMaxLength) {
+		error = "data fork too large";
+		return false;
+	}
+	out.resize(r.length);
+
+	auto truncated = [&error](){
+		error = "truncated thread";
+		return false;
+	};
+
+	le_cursor c(r.data);
+	switch(r.format) {
+		case format_uncompressed:
+			if (r.data.size() < r.length) return truncated();
+			if (r.length) memcpy(out.data(), r.data.begin(), r.length);
+			return true;
+
+		case format_lzw1:
+		case format_lzw2:
+			break;
+
+		default:
+			error = "unsupported thread format " + std::to_string(r.format);
+			return false;
+	}
+
+	// lzw/1: crc, volume, rle delimiter, then 4k chunks of
+	// rle length, lzw flag, data.  The table is reset for each chunk.
+	// lzw/2: volume, rle delimiter, then 4k chunks of rle length | lzw
+	// flag, [lzw length], data.  The table carries over unless cleared.
+	bool lzw2 = r.format == format_lzw2;
+	uint16_t crc;
+	uint8_t volume;
+	uint8_t delim;
+
+	if ((!lzw2 && !c.read(crc)) || !c.read(volume) || !c.read(delim))
+		return truncated();
+
+	// out is reused, so a short thread must not fall through to stale
+	// bytes.
+	uint32_t produced = 0;
+
+	reset();
+	for (uint32_t offset = 0; offset < r.length; offset += 4096) {
+		uint16_t length;
+		bool packed;
+
+		if (!c.read(length)) return truncated();
+		if (lzw2) {
+			packed = length & 0x8000;
+			length &= 0x1fff;
+			uint16_t tmp;
+			if (packed && !c.read(tmp)) return truncated();
+		} else {
+			uint8_t flag;
+			if (!c.read(flag)) return truncated();
+			packed = flag;
+			reset();
+		}
+		if (length > 4096) {
+			error = "bad chunk length";
+			return false;
+		}
+
+		const uint8_t *in;
+		if (packed) {
+			if (!lzw(c, length, _packed)) {
+				error = "bad lzw data";
+				return false;
+			}
+			in = _packed;
+		} else {
+			in = c.position();
+			if (!c.skip(length)) return truncated();
+			if (lzw2) reset();
+		}
+
+		uint32_t n = std::min<uint32_t>(4096, r.length - offset);
+		if (length == 4096) {
+			memcpy(out.data() + offset, in, n);
+			produced += n;
+			continue;
+		}
+		if (!unrle(in, length, delim, _chunk)) {
+			error = "bad rle data";
+			return false;
+		}
+		memcpy(out.data() + offset, _chunk, n);
+		produced += n;
+	}
+	if (produced < r.length) return truncated();
+	return true;
+}
+
+
+// length bytes of variable width (9-12 bit, lsb first) codes.  Code
+// 0x100 clears the table.
+bool nufx_archive::expander::lzw(le_cursor &c, unsigned length, uint8_t *out) {
+
+	const uint8_t *p = c.position();
+	const size_t bits = c.remaining() * 8;
+	size_t bit = 0;
+	unsigned n = 0;
+
+	while (n < length) {
+		// one entry behind the compressor.
+		unsigned next = _entry + 1;
+		unsigned width = next < 0x200 ? 9 : next < 0x400 ? 10 : next < 0x800 ? 11 : 12;
+		if (bits - bit < width) return false;
+
+		size_t i = bit >> 3;
+		uint32_t v = p[i];
+		if ((bit & 7) + width > 8) v |= p[i + 1] << 8;
+		if ((bit & 7) + width > 16) v |= p[i + 2] << 16;
+		unsigned code = (v >> (bit & 7)) & ((1 << width) - 1);
+		bit += width;
+
+		if (code == 0x100) {
+			reset();
+			continue;
+		}
+
+		if (_first) {
+			if (code > 0xff) return false;
+			_old = code;
+			_final = code;
+			out[n++] = code;
+			_first = false;
+			continue;
+		}
+
+		unsigned x = code;
+		unsigned sp = 0;
+		if (x > _entry || (x == _entry && _entry == 0x1000)) return false;
+		if (x == _entry) {
+			_stack[sp++] = _final;
+			x = _old;
+		}
+		while (x > 0xff) {
+			if (sp == sizeof(_stack)) return false;
+			_stack[sp++] = _suffix[x];
+			x = _prefix[x];
+		}
+		_final = x;
+		if (sp == sizeof(_stack)) return false;
+		_stack[sp++] = x;
+
+		while (sp && n < length) out[n++] = _stack[--sp];
+
+		if (_entry < 0x1000) {
+			_prefix[_entry] = _old;
+			_suffix[_entry] = _final;
+			++_entry;
+		}
+		_old = code;
+	}
+
+	c.skip((bit + 7) >> 3);
+	return true;
+}
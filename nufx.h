@@ -0,0 +1,73 @@
+#ifndef __nufx_h__
+#define __nufx_h__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+#include "le_view.h"
+
+// NuFX (ShrinkIt) archives, optionally in a Binary II wrapper (.bxy).
+// Thread data is not copied; data forks are expanded (uncompressed,
+// LZW/1 or LZW/2) into a caller supplied buffer.  CRCs aren't checked.
+
+class nufx_archive {
+
+public:
+
+	enum {
+		format_uncompressed = 0,
+		format_squeeze = 1,
+		format_lzw1 = 2,
+		format_lzw2 = 3,
+	};
+
+	struct record {
+		std::string name;
+		uint16_t file_type = 0;
+		uint32_t aux_type = 0;
+
+		// data fork.
+		le_view data;
+		uint16_t format = 0;
+		uint32_t length = 0; // expanded
+	};
+
+	// on failure, error is set if it looked like a NuFX archive.
+	bool open(const uint8_t *data, size_t size, std::string &error);
+
+	// records with a data fork.
+	const std::vector<record> &records() const { return _records; }
+
+	// expand r's data fork into out.  The lzw tables are kept between
+	// calls, so each thread should use its own expander.
+	class expander {
+	public:
+		bool expand(const record &r, std::vector<uint8_t> &out, std::string &error);
+
+	private:
+		bool lzw(le_cursor &c, unsigned length, uint8_t *out);
+		void reset() { _entry = 0x101; _first = true; }
+
+		uint16_t _prefix[4096];
+		uint8_t _suffix[4096];
+		uint8_t _stack[4096];
+		unsigned _entry = 0x101;
+		unsigned _old = 0;
+		uint8_t _final = 0;
+		bool _first = true;
+
+		// a 4k chunk before and after rle.
+		uint8_t _packed[4096];
+		uint8_t _chunk[4096];
+	};
+
+private:
+
+	bool parse(le_cursor &c, std::string &error);
+
+	std::vector<record> _records;
+};
+
+#endif
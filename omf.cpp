@@ -0,0 +1,275 @@
+#include "omf.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+
+namespace {
+
+	std::string hex(uint32_t x) {
+		char buffer[12];
+		snprintf(buffer, sizeof(buffer), "$%02x", x);
+		return buffer;
+	}
+}
+
+
+bool omf_file::open(const uint8_t *data, size_t size, std::string &error) {
+
+	_segments.clear();
+	error.clear();
+
+	le_view file(data, size);
+
+	// all segments must be version 2, 4-byte little endian numbers.
+	if (!file.has(44) || file.u8(15) != 2 || file.u8(14) != 4 || file.u8(32) != 0)
+		return false;
+
+	le_cursor c(file);
+	while (!c.empty()) {
+
+		segment s;
+		le_view v;
+		if (!c.has(44) || !c.take(le_view(c.position(), 4).u32(0), v) || !parse(v, s, error)) {
+			if (error.empty()) error = "bad segment header";
+			error = "segment " + std::to_string(_segments.size() + 1) + ": " + error;
+			_segments.clear();
+			return false;
+		}
+		_segments.emplace_back(std::move(s));
+	}
+
+	for (auto &s : _segments) {
+		s.address = s.org ? s.org : s.segnum << 16;
+		std::stable_sort(s.relocs.begin(), s.relocs.end(), [](const reloc &a, const reloc &b){
+			return a.offset < b.offset;
+		});
+	}
+	return true;
+}
+
+
+// v is the segment (BYTECNT bytes).
+bool omf_file::parse(const le_view &v, segment &s, std::string &error) {
+
+	if (!v.has(44)) return false;
+
+	uint8_t lablen = v.u8(13);
+	uint8_t numlen = v.u8(14);
+	uint8_t version = v.u8(15);
+	uint8_t numsex = v.u8(32);
+	uint16_t dispname = v.u16(40);
+	uint16_t dispdata = v.u16(42);
+
+	if (version != 2 || numlen != 4 || numsex) {
+		error = "unsupported segment version";
+		return false;
+	}
+	if (dispname < 44 || dispname + 10 > dispdata || dispdata > v.size()) {
+		error = "bad segment header";
+		return false;
+	}
+
+	s.length = v.u32(8);
+	s.banksize = v.u32(16);
+	s.kind = v.u16(20);
+	s.org = v.u32(24);
+	s.segnum = v.u16(34);
+	s.entry = v.u32(36);
+
+	s.loadname.assign((const char *)v.begin() + dispname, 10);
+	while (!s.loadname.empty() && s.loadname.back() == ' ') s.loadname.pop_back();
+
+	le_view names = v.sub(dispname + 10, dispdata - dispname - 10);
+	unsigned name_length = lablen ? lablen : names.has(1) ? names.u8(0) : 0;
+	if (!names.has(lablen ? 0 : 1, name_length) || (!lablen && names.empty())) {
+		error = "bad segment name";
+		return false;
+	}
+	s.name.assign((const char *)names.begin() + (lablen ? 0 : 1), name_length);
+	while (!s.name.empty() && s.name.back() == ' ') s.name.pop_back();
+
+
+	le_cursor c(v.sub(dispdata));
+	le_view r;
+	uint32_t pc = 0;
+	size_t at = 0;
+
+	auto truncated = [&](){
+		error = "truncated record at " + hex(dispdata + at);
+		return false;
+	};
+
+	// segments are limited to the 24-bit address space.
+	auto add_span = [&](uint32_t length, const uint8_t *data){
+		if (length > 0x1000000 - pc) {
+			error = "bad segment length";
+			return false;
+		}
+		if (length) s.spans.push_back({pc, length, data});
+		pc += length;
+		return true;
+	};
+
+	for(;;) {
+		uint8_t op;
+		at = c.offset();
+		if (!c.read(op)) return truncated();
+
+		if (op == 0x00) break;
+
+		if (op <= 0xdf) {
+			// CONST
+			if (!c.take(op, r)) return truncated();
+			if (!add_span(op, r.begin())) return false;
+			continue;
+		}
+
+		switch(op) {
+			case 0xf2: { // LCONST
+				uint32_t n;
+				if (!c.read(n) || !c.take(n, r)) return truncated();
+				if (!add_span(n, r.begin())) return false;
+				break;
+			}
+
+			case 0xf1: { // DS
+				uint32_t n;
+				if (!c.read(n)) return truncated();
+				if (!add_span(n, nullptr)) return false;
+				break;
+			}
+
+			case 0xe2: // RELOC
+				if (!c.take(10, r)) return truncated();
+				s.relocs.push_back({r.u32(2), r.u8(0), (int8_t)r.u8(1), 0, 0, r.u32(6)});
+				break;
+
+			case 0xf5: // cRELOC
+				if (!c.take(6, r)) return truncated();
+				s.relocs.push_back({r.u16(2), r.u8(0), (int8_t)r.u8(1), 0, 0, r.u16(4)});
+				break;
+
+			case 0xe3: // INTERSEG
+				if (!c.take(14, r)) return truncated();
+				// other files (libraries) can't be resolved; leave the value as is.
+				s.relocs.push_back({r.u32(2), r.u8(0), (int8_t)r.u8(1), 0,
+					(uint16_t)(r.u16(6) == 1 ? r.u16(8) : 0xffff), r.u32(10)});
+				break;
+
+			case 0xf6: // cINTERSEG
+				if (!c.take(7, r)) return truncated();
+				s.relocs.push_back({r.u16(2), r.u8(0), (int8_t)r.u8(1), 0, r.u8(4), r.u16(5)});
+				break;
+
+			case 0xf7: { // SUPER
+				uint32_t length;
+				if (!c.read(length) || !length || !c.take(length, r)) return truncated();
+				uint8_t type = r.u8(0);
+
+				reloc rr = {0, 0, 0, reloc::in_place, 0, 0};
+				if (type == 0) rr.size = 2;
+				else if (type == 1) rr.size = 3;
+				else if (type == 2) { rr.size = 3; rr.flags |= reloc::segment_in_place; }
+				else if (type >= 14 && type <= 25) { rr.size = 2; rr.segment = type - 13; }
+				else break; // other files or bank-byte references -- left as is.
+
+				le_cursor sc(r.sub(1));
+				uint32_t page = 0;
+				for (uint8_t count; sc.read(count); ) {
+					if (count & 0x80) {
+						page += count & 0x7f;
+						continue;
+					}
+					uint8_t lo;
+					for (unsigned i = 0; i <= count && sc.read(lo); ++i) {
+						rr.offset = (page << 8) | lo;
+						s.relocs.push_back(rr);
+					}
+					++page;
+				}
+				break;
+			}
+
+			default:
+				error = "unsupported record " + hex(op) + " at " + hex(dispdata + at);
+				return false;
+		}
+	}
+
+	// reserved space at the end is zero filled, like DS.
+	if (s.length > pc && !add_span(s.length - pc, nullptr)) return false;
+	s.length = pc;
+	return true;
+}
+
+
+uint32_t omf_file::address(uint16_t segnum) const {
+	for (const auto &s : _segments)
+		if (s.segnum == segnum) return s.address;
+	return 0;
+}
+
+
+void omf_file::raw(const segment &s, uint32_t offset, uint32_t length, uint8_t *out) const {
+
+	memset(out, 0, length);
+
+	auto iter = std::upper_bound(s.spans.begin(), s.spans.end(), offset, [](uint32_t offset, const span &sp){
+		return offset < sp.offset;
+	});
+	if (iter != s.spans.begin()) --iter;
+
+	uint32_t end = offset + length;
+	for (; iter != s.spans.end() && iter->offset < end; ++iter) {
+		uint32_t b = std::max(offset, iter->offset);
+		uint32_t e = std::min(end, iter->offset + iter->length);
+		if (b >= e || !iter->data) continue;
+		memcpy(out + (b - offset), iter->data + (b - iter->offset), e - b);
+	}
+}
+
+
+void omf_file::read(const segment &s, uint32_t offset, uint32_t length, uint8_t *out) const {
+
+	raw(s, offset, length, out);
+
+	// relocations are at most 4 bytes so anything starting 3 bytes
+	// before the window may overlap it.
+	uint32_t first = offset > 3 ? offset - 3 : 0;
+	auto iter = std::lower_bound(s.relocs.begin(), s.relocs.end(), first, [](const reloc &r, uint32_t offset){
+		return r.offset < offset;
+	});
+
+	uint32_t end = offset + length;
+	for (; iter != s.relocs.end() && iter->offset < end; ++iter) {
+		const reloc &r = *iter;
+		uint32_t value = r.value;
+		uint16_t segnum = r.segment;
+		if (r.flags & reloc::in_place) {
+			uint8_t tmp[4];
+			raw(s, r.offset, 4, tmp);
+			le_view t(tmp, 4);
+			if (r.flags & reloc::segment_in_place) {
+				value = t.u16(0);
+				segnum = t.u8(2);
+			} else {
+				value = t.u32(0);
+				if (r.size < 4) value &= (UINT32_C(1) << (8 * r.size)) - 1;
+			}
+		}
+
+		if (segnum != 0xffff)
+			value += segnum ? address(segnum) : s.address;
+
+		if (r.shift <= -32 || r.shift >= 32) value = 0;
+		else if (r.shift < 0) value >>= -r.shift;
+		else value <<= r.shift;
+
+		for (unsigned i = 0; i < r.size && i < 4; ++i) {
+			uint32_t x = r.offset + i;
+			if (x >= offset && x < end) out[x - offset] = value >> (8 * i);
+		}
+	}
+}
@@ -0,0 +1,78 @@
+#ifndef __omf_h__
+#define __omf_h__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+#include "le_view.h"
+
+// Apple IIgs OMF (version 2) load files.
+// Segment data is not copied -- LCONST/CONST records point into the
+// (mapped) file and relocations are applied as bytes are read.
+
+class omf_file {
+
+public:
+
+	struct span {
+		uint32_t offset;
+		uint32_t length;
+		const uint8_t *data; // nullptr for DS
+	};
+
+	struct reloc {
+		enum {
+			// value is stored in the segment data, not the record.
+			in_place = 1,
+			// ... and the segment number is in the high byte (INTERSEG1).
+			segment_in_place = 2,
+		};
+
+		uint32_t offset;
+		uint8_t size;
+		int8_t shift;
+		uint8_t flags;
+		uint16_t segment; // 0 = this segment
+		uint32_t value;
+	};
+
+	struct segment {
+		uint16_t segnum = 0;
+		uint16_t kind = 0;
+		uint32_t length = 0;
+		uint32_t org = 0;
+		uint32_t banksize = 0;
+		uint32_t entry = 0;
+		std::string name;
+		std::string loadname;
+
+		// load address (org, or a bank of its own).
+		uint32_t address = 0;
+
+		std::vector<span> spans;
+		std::vector<reloc> relocs;
+
+		bool code() const { return (kind & 0x1f) == 0x00; }
+	};
+
+	// on failure, error is set if it looked like an OMF file.
+	bool open(const uint8_t *data, size_t size, std::string &error);
+
+	const std::vector<segment> &segments() const { return _segments; }
+
+	// relocated bytes [offset, offset + length) of s.
+	void read(const segment &s, uint32_t offset, uint32_t length, uint8_t *out) const;
+
+private:
+
+	bool parse(const le_view &v, segment &s, std::string &error);
+
+	void raw(const segment &s, uint32_t offset, uint32_t length, uint8_t *out) const;
+	uint32_t address(uint16_t segnum) const;
+
+	std::vector<segment> _segments;
+};
+
+#endif
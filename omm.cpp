@@ -0,0 +1,313 @@
+#include "omm.h"
+#include "disassembler.h"
+#include "emulator.h"
+#include "signatures.h"
+
+#include <string.h>
+#include <algorithm>
+#include <cxx/vector.h>
+
+
+static const unsigned rom_addresses[] = {
+#undef _
+#define _(a,b) a,
+#include "rom_labels.h"
+#undef _
+};
+
+
+bool read_header(const uint8_t *data, size_t size, header &h, bool exact) {
+
+	le_view v(data, size);
+	if (!v.has(16 + 3)) return false;
+
+	h.version = v.u16(0);
+	h.id = v.u16(2);
+	h.size = v.u16(4);
+	h.org = v.u16(6);
+	h.amperct = v.u16(8);
+	h.kind = v.u16(10);
+	h.res1 = v.u16(12);
+	h.res2 = v.u16(14);
+
+
+	// sanity check the header fields....
+
+	if (h.res1 || h.res2 || h.kind) return false;
+
+	if (h.version > 1 || h.size < 3) return false;
+
+	if (exact ? h.size + 16 != size : h.size + 16 > size) return false;
+
+	if (h.amperct && h.amperct >= h.size + h.org) return false;
+
+	if (h.amperct && h.amperct <= h.org) return false;
+
+	return true;
+}
+
+
+// entries (jump targets) of a jump table, bounded by the table size
+// (from a cmp/cpx before the jump) or the next label.
+static std::vector<uint32_t> read_table(const module &m, const analyzer::table &t,
+	const uint8_t *begin, const std::vector<unsigned> &labels) {
+
+	std::vector<uint32_t> rv;
+
+	auto in_module = [&](uint32_t x){
+		return x >= m.address_space.first && x < m.address_space.second;
+	};
+
+	auto next_label = [&](uint32_t address){
+		uint32_t bound = m.address_space.second;
+		for (auto x : labels) {
+			if (x > address && x < bound) bound = x;
+		}
+		return bound;
+	};
+
+	if (!in_module(t.address) || (t.hi && !in_module(t.hi))) return rv;
+
+	uint32_t bound = next_label(t.address);
+	uint32_t hi_bound = t.hi ? next_label(t.hi) : 0;
+	unsigned count = t.count ? t.count : 128;
+
+	for (unsigned i = 0; i < count; ++i) {
+		uint32_t x;
+
+		if (t.hi) {
+			if (t.address + i >= bound || t.hi + i >= hi_bound) break;
+			x = begin[t.address + i - m.h.org] | (begin[t.hi + i - m.h.org] << 8);
+			x = (x + 1) & 0xffff;
+		} else {
+			if (t.address + i * 2 + 2 > bound) break;
+			x = le_view(begin, m.h.size).u16(t.address + i * 2 - m.h.org);
+		}
+
+		// without a size, stop at the first entry outside the module.
+		if (!t.count && !in_module(x)) break;
+		rv.push_back(x);
+	}
+	return rv;
+}
+
+// decode from pc to the first rts/jmp/etc.
+static uint32_t code_end(const uint8_t *begin, uint32_t org, uint32_t pc, uint32_t limit) {
+	while (pc < limit) {
+		uint8_t op = begin[pc - org];
+		unsigned size = disassembler::operand_size(op, false, false);
+
+		// inline parameters
+		if (op == 0x20 && pc + 3 <= limit) {
+			uint32_t arg = begin[pc + 1 - org] | (begin[pc + 2 - org] << 8);
+			size += inline_params::standard().length(arg, begin + (pc + 3 - org), begin + (limit - org));
+		}
+
+		pc += 1 + size;
+		if (disassembler::terminal(op)) break;
+	}
+	return std::min(pc, limit);
+}
+
+
+void analyze(module &m, const header &h, const uint8_t *data, unsigned flags) {
+
+	auto &labels = m.labels;
+	auto &address_space = m.address_space;
+	auto &code_address_space = m.code_address_space;
+	auto &data_address_space = m.data_address_space;
+	auto &immediate_address_space = m.immediate_address_space;
+
+	const auto begin = data + 16;
+	const auto end = begin + h.size;
+
+	auto end_code = end;
+	auto end_immediate = end;
+	//auto end_data = end;
+
+	m.h = h;
+	address_space = std::make_pair(h.org, h.org + h.size);
+	labels.clear();
+
+	code_address_space.first = h.org;	
+
+	// one per thread, reused for every module and region.
+	static thread_local analyzer anna;
+	anna.reset();
+	anna.set_m(false);
+	anna.set_x(false);
+	anna.set_pc(h.org);
+
+	auto iter = begin;
+	for ( ; iter != end; ++iter) {
+		uint8_t op = *iter;
+		if (op == 0 && anna.state()) {
+			// version 1 requires 3 0s to terminate code.
+			if (h.version == 0 || (anna.op() == 0 && anna.arg() == 0)) {
+				end_code = iter;
+				++iter;
+				break;
+			}
+		}
+		anna(op);
+	}
+
+	labels = anna.finish();
+	std::vector<analyzer::table> tables = anna.tables();
+	m.zp_reads = anna.dp_reads();
+	m.zp_writes = anna.dp_writes();
+	erase_if(labels, [&address_space](uint32_t x){
+		return x < address_space.first || x > address_space.second;
+	});
+
+	if (h.amperct) labels.push_back(h.amperct);
+
+	unsigned offset = std::distance(begin, iter) + h.org;
+
+	code_address_space.second = offset - 1;
+	immediate_address_space.first = offset;
+
+	// immediate table (keep references).  If it's not terminated,
+	// any odd byte is left for the data section.
+	le_cursor c(iter, end);
+	for (uint16_t x; ; offset += 2) {
+		if (!c.read(x)) {
+			end_immediate = c.position();
+			break;
+		}
+		if (x == 0) {
+			end_immediate = c.position() - 2;
+			break;
+		}
+		if (x >= address_space.first && x < address_space.second) labels.push_back(x);
+		//labels.push_back(offset);
+	}
+
+	immediate_address_space.second = offset - 2;
+	// data!
+
+	data_address_space.first = offset;
+	data_address_space.second = h.org + h.size;
+
+	auto &code_regions = m.code_regions;
+	code_regions.clear();
+
+	uint32_t free_form = h.amperct ? h.amperct : data_address_space.second;
+
+	if (flags & analyze_classify) {
+		// speculatively decode anything referenced in the data section.
+		classifier c(begin, h.size, h.org);
+		for (auto x : rom_addresses) c.add_known(x);
+		for (auto x : labels) c.add_reference(x);
+		for (auto x : anna.calls()) c.add_reference(x, classifier::call);
+
+		code_regions = c.classify(data_address_space.first, free_form);
+		erase_if(code_regions, [](const classifier::region &r){
+			return !r.code;
+		});
+	}
+
+	if (flags & analyze_emulate) {
+		// run it and see what executes.
+		emulator e(begin, h.size, h.org);
+		e.add_entry(h.org);
+		e.run();
+
+		for (auto x : e.targets()) {
+			if (x >= address_space.first && x < address_space.second) labels.push_back(x);
+		}
+
+		for (const auto &r : e.runs(data_address_space.first, free_form)) {
+			classifier::region tmp;
+			tmp.begin = r.first;
+			tmp.end = r.second;
+			tmp.code = true;
+			code_regions.push_back(tmp);
+		}
+
+		// merge with the classifier regions.
+		std::sort(code_regions.begin(), code_regions.end(),
+			[](const classifier::region &a, const classifier::region &b){
+				return a.begin < b.begin;
+			}
+		);
+		std::vector<classifier::region> tmp;
+		for (const auto &r : code_regions) {
+			if (!tmp.empty() && r.begin <= tmp.back().end)
+				tmp.back().end = std::max(tmp.back().end, r.end);
+			else tmp.push_back(r);
+		}
+		code_regions.swap(tmp);
+	}
+
+	auto in_free_form = [&](uint32_t x){
+		return x >= data_address_space.first && x < free_form;
+	};
+
+	auto analyze_region = [&](const classifier::region &r) {
+		anna.reset();
+		anna.set_m(false);
+		anna.set_x(false);
+		anna.set_pc(r.begin);
+		for (auto i = r.begin; i < r.end; ++i) anna(begin[i - h.org]);
+		for (auto x : anna.finish()) {
+			if (x >= address_space.first && x < address_space.second) labels.push_back(x);
+		}
+		tables.insert(tables.end(), anna.tables().begin(), anna.tables().end());
+		m.zp_reads |= anna.dp_reads();
+		m.zp_writes |= anna.dp_writes();
+	};
+
+	for (const auto &r : code_regions) analyze_region(r);
+
+	// jump tables.  targets in the data section are code, which may
+	// have more jump tables...
+	m.jump_tables.clear();
+	for (size_t i = 0; i < tables.size(); ++i) {
+		const auto t = tables[i];
+		auto targets = read_table(m, t, begin, labels);
+
+		if (!t.hi && !targets.empty() && in_free_form(t.address) && in_free_form(t.address + targets.size() * 2 - 1))
+			m.jump_tables.emplace_back(t.address, t.address + targets.size() * 2);
+
+		for (auto x : targets) {
+			if (x < address_space.first || x >= address_space.second) continue;
+			labels.push_back(x);
+
+			if (!in_free_form(x)) continue;
+			uint32_t limit = free_form;
+			bool found = false;
+			for (const auto &r : code_regions) {
+				if (x >= r.begin && x < r.end) found = true;
+				if (r.begin > x) limit = std::min(limit, r.begin);
+			}
+			if (found) continue;
+
+			classifier::region r;
+			r.begin = x;
+			r.end = code_end(begin, h.org, x, limit);
+			r.code = true;
+			code_regions.push_back(r);
+			analyze_region(r);
+		}
+	}
+
+	std::sort(code_regions.begin(), code_regions.end(),
+		[](const classifier::region &a, const classifier::region &b){
+			return a.begin < b.begin;
+		}
+	);
+	std::sort(m.jump_tables.begin(), m.jump_tables.end());
+
+	std::sort(labels.begin(), labels.end(), std::greater<unsigned>());
+	labels.erase(std::unique(labels.begin(), labels.end()), labels.end());
+
+	m.begin = begin;
+	m.end = end;
+	m.end_code = end_code;
+	m.end_immediate = end_immediate;
+
+	m.names.clear();
+	const auto &signatures = signature_set::standard();
+	if (!signatures.empty()) m.names = signatures.match(m);
+}
@@ -0,0 +1,75 @@
+#ifndef __omm_h__
+#define __omm_h__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <bitset>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "classifier.h"
+#include "le_view.h"
+
+#pragma pack(push, 1)
+
+struct header {
+	uint16_t version = 0;
+	uint16_t id = 0;
+	uint16_t size = 0;
+	uint16_t org = 0;
+	uint16_t amperct = 0;
+	uint16_t kind = 0;
+	uint16_t res1 = 0;
+	uint16_t res2 = 0;
+};
+
+#pragma pack(pop)
+
+
+// header, opcodes, immediate table, data
+// opcodes end w/ 0 byte []
+
+struct module {
+	header h;
+
+	const uint8_t *begin = nullptr;
+	const uint8_t *end = nullptr;
+	const uint8_t *end_code = nullptr;
+	const uint8_t *end_immediate = nullptr;
+
+	std::pair<unsigned, unsigned> address_space;
+	std::pair<unsigned, unsigned> code_address_space;
+	std::pair<unsigned, unsigned> data_address_space;
+	std::pair<unsigned, unsigned> immediate_address_space;
+
+	// sorted, descending.
+	std::vector<unsigned> labels;
+	std::vector<classifier::region> code_regions;
+	// [begin, end) word jump tables in the data section.
+	std::vector<std::pair<unsigned, unsigned>> jump_tables;
+
+	// zero page bytes read/written by the code.
+	std::bitset<256> zp_reads;
+	std::bitset<256> zp_writes;
+
+	// (address, name) of routines recognized by signature, sorted.
+	std::vector<std::pair<unsigned, std::string>> names;
+};
+
+
+// validate an OMM header at data.  if exact, the module must fill
+// the entire buffer, otherwise it may be followed by other data.
+bool read_header(const uint8_t *data, size_t size, header &h, bool exact = true);
+
+enum {
+	// speculatively decode the data section.
+	analyze_classify = 1,
+	// run the module (from org) to find code in the data section.
+	analyze_emulate = 2,
+};
+
+// find the section boundaries and labels.  data points to the header.
+void analyze(module &m, const header &h, const uint8_t *data, unsigned flags = 0);
+
+#endif
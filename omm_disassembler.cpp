@@ -5,16 +5,61 @@
 #include <cxx/vector.h>
 
 #include "disassembler.h"
+#include "scanner.h"
+#include "symbols.h"
+#include "inline_params.h"
+#include "omm.h"
+#include "omf.h"
+#include "diff.h"
+#include "daemon.h"
+#include "dialect.h"
+#include "zero_page.h"
+#include "cycles.h"
+#include "call_graph.h"
+#include "nufx.h"
+#include "signatures.h"
+#include "block_hash.h"
+#include "parallel.h"
+#include "spsc_queue.h"
+#include "label_table.h"
+#include "line_index.h"
 
 #include <string>
 #include <vector>
 #include <utility>
 #include <algorithm>
+#include <deque>
 #include <unordered_map>
+#include <array>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <atomic>
 
+#include <string.h>
 #include <unistd.h>
+#include <getopt.h>
 
 
+bool flag_c = false;
+bool flag_d = false;
+bool flag_e = false;
+bool flag_s = false;
+bool flag_x = false;
+bool flag_z = false;
+bool flag_v = false;
+unsigned flag_t = cpu_none;
+bool flag_diff = false;
+
+const dialect *flag_f = &dialect::standard();
+
+static unsigned analyze_flags() {
+	return (flag_c ? analyze_classify : 0) | (flag_e ? analyze_emulate : 0);
+}
+
+// from the -L symbol file.
+std::vector<std::pair<unsigned, std::string>> user_symbols;
+
 std::string tokens[] = {
 #undef _
 #undef __
@@ -27,13 +72,179 @@ std::string tokens[] = {
 
 
 
+// rom, mli and omm entry points.
+static const std::pair<unsigned, const char *> rom_table[] = {
+#undef _
+#define _(a,b) { a, #b },
+#include "rom_labels.h"
+#undef _
+};
+
+#define _(a,b) { a, #b }
+
+// zero page locations.
+static const std::pair<unsigned, const char *> zp_table[] = {
+	_(0x00, d0),
+	_(0x01, d1),
+	_(0x02, d2),
+	_(0x03, d3),
+	_(0x04, strsav),
+	_(0x0a, usrjmp),
+	_(0x11, valtyp),
+	_(0x19, number),
+	_(0x1a, shapel),
+	_(0x1c, hcolor1),
+	_(0x20, wndlft),
+	_(0x21, wndwid),
+	_(0x22, wndtop),
+	_(0x23, wndbot),
+	_(0x24, ch),
+	_(0x25, cv),
+	_(0x28, basl), 
+	_(0x32, invflg),
+	_(0x33, prompt),
+	_(0x36, cswl),
+	_(0x38, kswl),
+	_(0x3c, a1),
+	_(0x3e, a2),
+	_(0x42, a4),
+	_(0x4e, rndl),
+	_(0x50, linnum),
+	_(0x52, temptr),
+	_(0x5e, index),
+	_(0x6d, strend),
+	_(0x6f, fretop),
+	_(0x71, frespc),
+	_(0x73, himem),
+	_(0x75, curlin),
+	_(0x81, varnam),
+	_(0x83, varpnt),
+	_(0x85, forpnt),
+	_(0x9b, lowtr),
+	_(0x9d, fac),
+	_(0xa0, strptr),
+	_(0xa2, facsgn),
+	_(0xb1, chrget),
+	_(0xb7, chrgot),
+	_(0xb8, txtptr),
+	_(0xd8, errflg),
+	_(0xda, errlin),
+	_(0xde, errnum),
+	//_(0xe4, hcolorz),
+	_(0xf8, remstk),
+	_(0xfa, varptr),
+	_(0xfd, varptr2),
+	_(0xe9, zfree1),
+	_(0xef, zfree2),
+	_(0xf0, zfree3),
+
+
+	{ 0x3d, "a1+1" },
+	{ 0x4f, "rndl+1" },
+	{ 0xb9, "txtptr+1" },
+	{ 0x51, "linum+1" },
+
+	{ 0xe0, "prmtbl" },
+	{ 0xe1, "prmtbl+1" },
+	{ 0xe2, "prmtbl+2" },
+	{ 0xe3, "prmtbl+3" },
+	{ 0xe4, "prmtbl+4" },
+	{ 0xe5, "prmtbl+5" },
+};
+
+#undef _
+
+
+// built-in and -L symbols, shared (read only) by every instance.
+// built on first use, after the options have been parsed.
+static const std::unordered_map<unsigned, std::string> &symbol_map() {
+	static const std::unordered_map<unsigned, std::string> map = [](){
+		std::unordered_map<unsigned, std::string> map;
+		for (const auto &e : rom_table) map.emplace(e.first, e.second);
+		for (const auto &e : user_symbols) map[e.first] = e.second;
+		return map;
+	}();
+	return map;
+}
+
+static const char *zp_name(unsigned address) {
+	static const auto names = [](){
+		std::array<const char *, 256> names = {};
+		for (const auto &e : zp_table) names[e.first] = e.second;
+		return names;
+	}();
+	return address < 256 ? names[address] : nullptr;
+}
+
+
+// puts, to the listing output.
+static void put(const char *s) {
+	disassembler::write(s, strlen(s));
+	disassembler::write("\n", 1);
+}
+
+// a * comment line, in the dialect's comment syntax.
+static void comment(const dialect &syntax, const char *s) {
+	if (*s == '*' && syntax.traits & disassembler::ca65_size_prefix) {
+		disassembler::write(";", 1);
+		++s;
+	}
+	put(s);
+}
+
+static std::string hex_list(unsigned size, const uint8_t *data) {
+	static const char digits[] = "0123456789abcdef";
+	std::string tmp;
+	tmp.reserve(size * 5);
+	for (unsigned i = 0; i < size; ++i) {
+		if (i > 0) tmp += ", ";
+		tmp.push_back('$');
+		tmp.push_back(digits[data[i] >> 4]);
+		tmp.push_back(digits[data[i] & 0x0f]);
+	}
+	return tmp;
+}
+
+static void emit_directive(const disassembler &d, const char *op, const std::string &operand = "") {
+	if (op) d.emit("", op, operand);
+}
+
+// rendered listings (in any number of dialects) from one analysis.
+struct output {
+	const dialect *syntax;
+	FILE *file;
+	// --line-index
+	line_index *index = nullptr;
+};
+
+// render to each output, concurrently if there's more than one.
+template<class F>
+static void render_all(const std::vector<output> &outputs, F render) {
+	parallel_for(outputs.size(), outputs.size(), [&](size_t i){
+		disassembler::set_output(outputs[i].file, outputs[i].index);
+		render(*outputs[i].syntax);
+		disassembler::set_output(nullptr);
+	});
+}
+
+static const std::string *signature_name(const std::vector<std::pair<unsigned, std::string>> &names, uint32_t address) {
+	auto iter = std::lower_bound(names.begin(), names.end(), std::make_pair((unsigned)address, std::string()));
+	if (iter == names.end() || iter->first != address) return nullptr;
+	return &iter->second;
+}
+
 class omm_disassembler final : public disassembler {
 
 public:
-	omm_disassembler(std::vector<unsigned> &labels);
+	omm_disassembler() = default;
+	omm_disassembler(const module &m, const dialect &syntax) { reset(m, syntax); }
 
 	~omm_disassembler() = default;
 
+	// for another module (or dialect), keeping allocations.  A
+	// window only needs the labels in [first, last] and the one after.
+	void reset(const module &m, const dialect &syntax, uint32_t first = 0, uint32_t last = UINT32_MAX);
+
 protected:
 
 	virtual std::pair<std::string, std::string>
@@ -43,228 +254,55 @@ protected:
 	format_data(unsigned size, const std::string &data);
 
 	virtual std::string ds() const;
+	virtual std::pair<std::string, std::string> format_fill(unsigned count, uint8_t value);
 
 	virtual int32_t next_label(int32_t pc);
+	virtual int32_t label_after(uint32_t address);
 
 	virtual std::string label_for_address(uint32_t address);
 	virtual std::string label_for_zp(uint32_t address);
 
 
 private:
+	// pending (for next_label) and all analyzed labels, descending.
 	std::vector<unsigned> _labels;
-	std::unordered_map<unsigned, std::string> _label_map;
-	std::unordered_map<unsigned, std::string> _zp_label_map;
+	const std::vector<unsigned> *_module_labels = nullptr;
+	// recognized by signature, ascending.
+	const std::vector<std::pair<unsigned, std::string>> *_names = nullptr;
+	const dialect *_syntax = nullptr;
 };
 
-omm_disassembler::omm_disassembler(std::vector<unsigned> &labels)
-	 : disassembler(disassembler::mpw | disassembler::msb_hexdump | disassembler::bit_hacks),
-	 _labels(labels)
-{
-
-#undef _
-#define _(a,b) { a, #b }
-
-	_label_map.insert({
-
-		// zp but called as jsr $00xx
-		_(0xb1, chrget),
-		_(0xb7, chrgot),
-
-		 // usraddr
-		_(0x03f8, ommvec),
-		_(0x057b, ch80),
-
-		_(0xbe6c, vpath1),
-		_(0xbe6e, vpath2),
-
-		_(0xc000, kbd),
-		_(0xc010, strb),
-		_(0xc019, rdvblbar),
-		_(0xc036, cyareg),
-		_(0xc061, cmdkey),
-
-
-		_(0xd393, bltu),
-		_(0xd3e3, reason),
-		_(0xd412, error),
-		_(0xd52c, inlin),
-		_(0xd539, gdbufs),
-		_(0xd553, inchr),
-		_(0xd566, run),
-		_(0xd61a, fndlin),
-		_(0xd64b, scrtch),
-		_(0xd66c, clearc),
-		_(0xd683, stkini),
-		_(0xd697, stxtpt),
-		_(0xd7d2, newstt),
-		_(0xd849, restor),
-		_(0xd858, iscntc),
-		_(0xd898, cont),
-		_(0xd93e, goto),
-		_(0xd995, data),
-		_(0xd998, addon),
-		_(0xd9a3, datan),
-		_(0xd9a6, remn),
-		_(0xda0c, linget),
-		_(0xda46, let),
-		_(0xda7b, getspt),
-		_(0xdafb, crdo),
-		_(0xdb3a, strout),
-		_(0xdb3d, strprt),
-		_(0xdb57, outspc),
-		_(0xdb5a, outqst),
-		_(0xdb5c, outdo),
-		_(0xdd67, frmnum),
-		_(0xdd6a, chknum),
-		_(0xdd6c, chkstr),
-		_(0xdd6d, chkval),
-		_(0xdd7b, frmevl),
-		_(0xde81, strtxt),
-		_(0xdeb2, parchk),
-		_(0xdeb8, chkcls),
-		_(0xdebb, chkopn),
-		_(0xdebe, chkcom),
-		_(0xdec0, synchr),
-		_(0xdfe3, ptrget),
-		_(0xe07d, isletc),
-		_(0xe10c, ayint),
-		_(0xe2f2, givayf),
-		_(0xe301, sngflt),
-		_(0xe306, errdir),
-		_(0xe3d5, strini),
-		_(0xe3dd, strspa),
-		_(0xe3e7, strlit),
-		_(0xe3ed, strlt2),
-		_(0xe42a, putnew),
-		_(0xe452, getspa),
-		_(0xe484, garbag),
-		_(0xe5d4, movins),
-		_(0xe5e2, movstr),
-		_(0xe5fd, frestr),
-		_(0xe6f8, getbyte),
-		_(0xe752, getadr),
-		_(0xed24, prdec),
-		_(0xf941, prntax),
-		_(0xfc10, bs),
-		_(0xfc1a, up),
-		_(0xfc66, lf),
-		_(0xfd8e, crout),
-		_(0xfdda, prbyte),
-		_(0xfded, cout),
-
-	});
-
-
-	for (auto x : labels) {
-		_label_map.emplace(x, to_x(x,4,'_'));
-	}
-
-
-	_zp_label_map = {
-
-		_(0x00, d0),
-		_(0x01, d1),
-		_(0x02, d2),
-		_(0x03, d3),
-		_(0x04, strsav),
-		_(0x0a, usrjmp),
-		_(0x11, valtyp),
-		_(0x19, number),
-		_(0x1a, shapel),
-		_(0x1c, hcolor1),
-		_(0x20, wndlft),
-		_(0x21, wndwid),
-		_(0x22, wndtop),
-		_(0x23, wndbot),
-		_(0x24, ch),
-		_(0x25, cv),
-		_(0x28, basl), 
-		_(0x32, invflg),
-		_(0x33, prompt),
-		_(0x36, cswl),
-		_(0x38, kswl),
-		_(0x3c, a1),
-		_(0x3e, a2),
-		_(0x42, a4),
-		_(0x4e, rndl),
-		_(0x50, linnum),
-		_(0x52, temptr),
-		_(0x5e, index),
-		_(0x6d, strend),
-		_(0x6f, fretop),
-		_(0x71, frespc),
-		_(0x73, himem),
-		_(0x75, curlin),
-		_(0x81, varnam),
-		_(0x83, varpnt),
-		_(0x85, forpnt),
-		_(0x9b, lowtr),
-		_(0x9d, fac),
-		_(0xa0, strptr),
-		_(0xa2, facsgn),
-		_(0xb1, chrget),
-		_(0xb7, chrgot),
-		_(0xb8, txtptr),
-		_(0xd8, errflg),
-		_(0xda, errlin),
-		_(0xde, errnum),
-		//_(0xe4, hcolorz),
-		_(0xf8, remstk),
-		_(0xfa, varptr),
-		_(0xfd, varptr2),
-		_(0xe9, zfree1),
-		_(0xef, zfree2),
-		_(0xf0, zfree3),
-
-
-		{ 0x3d, "a1+1" },
-		{ 0x4f, "rndl+1" },
-		{ 0xb9, "txtptr+1" },
-		{ 0x51, "linum+1" },
-
-		{ 0xe0, "prmtbl" },
-		{ 0xe1, "prmtbl+1" },
-		{ 0xe2, "prmtbl+2" },
-		{ 0xe3, "prmtbl+3" },
-		{ 0xe4, "prmtbl+4" },
-		{ 0xe5, "prmtbl+5" },
-	};
-
+void omm_disassembler::reset(const module &m, const dialect &syntax, uint32_t first, uint32_t last) {
+	disassembler::reset();
+	set_traits(syntax.traits | disassembler::msb_hexdump | disassembler::bit_hacks);
+	// descending.
+	auto lo = std::lower_bound(m.labels.begin(), m.labels.end(), last, std::greater<unsigned>());
+	auto hi = std::upper_bound(lo, m.labels.end(), first, std::greater<unsigned>());
+	if (lo != m.labels.begin()) --lo;
+	_labels.assign(lo, hi);
+	_module_labels = &m.labels;
+	_names = &m.names;
+	_syntax = &syntax;
 	recalc_next_label();
 }
 
 std::pair<std::string, std::string>
 omm_disassembler::format_data(unsigned size, const uint8_t *data) {
-
-	std::string tmp;
-
-	for (unsigned i = 0; i < size; ++i) {
-		if (i > 0) tmp += ", ";
-		tmp += to_x(data[i], 2, '$');
-	}
-
-	return std::make_pair("dc.b", tmp);
+	return _syntax->data(1, hex_list(size, data));
 }
 
 std::pair<std::string, std::string>
 omm_disassembler::format_data(unsigned size, const std::string &data) {
-	switch(size) {
-		case 1: return std::make_pair("dc.b", data);
-		case 2: return std::make_pair("dc.w", data);
-		case 3: return std::make_pair("dc.a", data);
-		case 4: return std::make_pair("dc.l", data);
-
-		default: { 
-			std::string tmp;
-			tmp = std::to_string(size) + " bytes";
-			return std::make_pair(tmp, data);
-
-		}
-	}
+	return _syntax->data(size, data);
 }
 
 
-std::string omm_disassembler::ds() const { return "ds.b"; }
+std::string omm_disassembler::ds() const { return _syntax->space_op; }
+
+std::pair<std::string, std::string>
+omm_disassembler::format_fill(unsigned count, uint8_t value) {
+	return _syntax->fill(count, to_x(value, 2, '$'));
+}
 
 int32_t omm_disassembler::next_label(int32_t pc) {
 	if (_labels.empty()) return -1;
@@ -278,7 +316,7 @@ int32_t omm_disassembler::next_label(int32_t pc) {
 		if (address == pc) {
 			std::string tmp = label_for_address(pc);
 			if (tmp.empty()) tmp = to_x(address,4,'_');
-			emit(tmp);
+			emit(_syntax->label(tmp));
 		}
 		else {
 			warnx("Unable to place label _%04x",
@@ -293,397 +331,1490 @@ int32_t omm_disassembler::next_label(int32_t pc) {
 
 std::string omm_disassembler::label_for_address(uint32_t address) {
 
-	auto iter = _label_map.find(address);
-	if (iter == _label_map.end()) return ""; // to_x(address, 4, '_');
+	const auto &map = symbol_map();
+	auto iter = map.find(address);
+	if (iter != map.end()) return iter->second;
+
+	auto name = signature_name(*_names, address);
+	if (name) return *name;
+
+	if (std::binary_search(_module_labels->begin(), _module_labels->end(), address, std::greater<unsigned>()))
+		return to_x(address, 4, '_');
+	return "";
+}
 
-	return iter->second;
+int32_t omm_disassembler::label_after(uint32_t address) {
+	// descending, so the one before the first <= address.
+	auto iter = std::lower_bound(_module_labels->begin(), _module_labels->end(), address, std::greater<unsigned>());
+	if (iter == _module_labels->begin()) return -1;
+	return *--iter;
 }
 
 std::string omm_disassembler::label_for_zp(uint32_t address) {
 
-	auto iter = _zp_label_map.find(address);
-	if (iter == _label_map.end()) return "";
+	const char *name = zp_name(address);
+	return name ? name : "";
+}
+
+
+// a section heading.
+static void banner(const dialect &syntax, const char *title) {
+	put("");
+	comment(syntax, "*------------------------------*");
+	comment(syntax, title);
+	comment(syntax, "*------------------------------*");
+	put("");
+}
 
-	return iter->second;
+// an entry in the immediate table.
+static void immediate_word(omm_disassembler &d, const header &h, uint16_t x) {
+	std::string tmp;
+	if (x < h.org) tmp = d.to_x(x, 4,'$');
+	else tmp = d.to_x(x, 4, '_');
+	d(tmp, 2, x);
 }
 
+// free-form data (may include code!) in the data section:  runs of
+// data, code regions and jump tables.
+class data_section {
+
+public:
+	data_section(const module &m, omm_disassembler &d, const uint8_t *iter);
+
+	const uint8_t *position() const { return _iter; }
+	void seek(const uint8_t *iter) { _iter = iter; }
 
-#pragma pack(push, 1)
+	// the next item, or data up to limit.  Data stops at the first
+	// line at or after stop.
+	void next(const uint8_t *limit, const uint8_t *stop = nullptr);
 
-struct header {
-	uint16_t version = 0;
-	uint16_t id = 0;
-	uint16_t size = 0;
-	uint16_t org = 0;
-	uint16_t amperct = 0;
-	uint16_t kind = 0;
-	uint16_t res1 = 0;
-	uint16_t res2 = 0;
+private:
+	const module &_m;
+	omm_disassembler &_d;
+	const uint8_t *_iter;
+	std::vector<classifier::region>::const_iterator _region;
+	std::vector<std::pair<unsigned, unsigned>>::const_iterator _table;
 };
 
-#pragma pack(pop)
+data_section::data_section(const module &m, omm_disassembler &d, const uint8_t *iter)
+	: _m(m), _d(d), _iter(iter), _region(m.code_regions.begin()), _table(m.jump_tables.begin())
+{
+	// starting part way through (for a window), regions already passed.
+	unsigned pc = m.h.org + std::distance(m.begin, iter);
+	while (_region != m.code_regions.end() && pc >= _region->end) ++_region;
+}
+
+void data_section::next(const uint8_t *limit, const uint8_t *stop) {
+	const auto &h = _m.h;
+	const auto begin = _m.begin;
+	const auto end = _m.end;
+	const auto &code_regions = _m.code_regions;
+	auto &d = _d;
 
+	unsigned pc = h.org + std::distance(begin, _iter);
 
-template<class T>
-void swap_if(T &t, std::false_type) {}
+	while (_region != code_regions.end() && pc >= _region->end) {
+		d.set_code(false);
+		++_region;
+	}
+	if (_region != code_regions.end() && pc == _region->begin) d.set_code(true);
 
-void swap_if(uint8_t &, std::true_type) {}
+	while (_table != _m.jump_tables.end() && pc >= _table->second) ++_table;
+	if (_table != _m.jump_tables.end() && pc >= _table->first && pc + 2 <= _table->second) {
+		auto x = le_view(_iter, end).u16(0);
+		_iter += 2;
+		std::string tmp;
+		if (x >= h.org && x < h.org + h.size) tmp = d.to_x(x, 4, '_');
+		else tmp = d.to_x(x, 4, '$');
+		d(tmp, 2, x);
+		return;
+	}
 
-void swap_if(uint16_t &value, std::true_type) {
-	value = __builtin_bswap16(value);
+	if (!d.code()) {
+		// data up to the next code region or table in one go.
+		unsigned next = h.org + std::distance(begin, limit);
+		if (_region != code_regions.end()) next = std::min(next, _region->begin);
+		if (_table != _m.jump_tables.end()) next = std::min(next, _table->first);
+		if (next > pc) {
+			_iter = d.data(_iter, _iter + (next - pc), stop);
+			return;
+		}
+	}
+	d(*_iter++);
 }
 
-void swap_if(uint32_t &value, std::true_type) {
-	value = __builtin_bswap32(value);
+// custom parser for the ampersand table, from the current pc.
+// Returns the end of the table (the $ff).
+static const uint8_t *ampersand_table(omm_disassembler &d, const dialect &syntax, const uint8_t *iter, const uint8_t *end) {
+
+	std::string tmp;
+	unsigned pc = d.pc();
+	put("");
+	d.mark_line(pc);
+	d.emit(syntax.label("amperct"));
+
+	// usually token, 0 or 'text', 0
+	// but could include: 
+	// ON 'HANGUP' GOTO
+
+	std::string text;
+
+	le_cursor a(iter, end);
+	for (uint8_t c; a.read(c); ++pc) {
+		if (isascii(c) && isprint(c)) {
+			text.push_back(c);
+			continue;
+		}
+
+		if (!text.empty()) {
+			tmp += syntax.text(text);
+			tmp += ", ";
+			text.clear();
+		}
+
+		if (!tmp.empty()) {
+			if (c == 0x00) {
+				tmp += syntax.item("0");
+				d.emit("", syntax.data_op[1], tmp);
+				tmp.clear();
+				continue;
+			}
+		}
+
+		if (c >= 0x80 && c <= 0xea) {
+			tmp += syntax.item(tokens[c - 0x80]);
+			tmp += ", ";
+			continue;
+		}
+
+		auto l = syntax.data(1, d.to_x(c, 2, '$'));
+		d.emit("", l.first, l.second);
+		if (c == 0xff) {
+			++pc;
+			break;
+		}
+	}
+
+	put("");
+	d.set_pc(pc);
+	return a.position();
 }
 
-void swap_if(uint64_t &value, std::true_type) {
-	value = __builtin_bswap64(value);
+
+// -v: what the listings decoded, gathered by decode observers.
+static struct {
+	std::atomic<size_t> listings{0};
+	std::atomic<size_t> blocks{0};
+	std::atomic<size_t> events{0};
+	std::atomic<size_t> instructions{0};
+	std::atomic<size_t> labels{0};
+	std::atomic<size_t> data{0};
+} decode_totals;
+
+struct decode_counter {
+	size_t instructions = 0;
+	size_t labels = 0;
+	size_t data = 0;
+
+	void events(const decode_event *begin, const decode_event *end) {
+		for (auto e = begin; e != end; ++e) {
+			switch(e->kind) {
+				case decode_event::instruction: ++instructions; break;
+				case decode_event::label: ++labels; break;
+				case decode_event::data:
+				case decode_event::space: data += e->size; break;
+			}
+		}
+	}
+};
+
+struct block_counter {
+	size_t blocks = 0;
+	size_t items = 0;
+
+	void events(const decode_event *begin, const decode_event *end) {
+		++blocks;
+		items += end - begin;
+	}
+};
+
+static void render(const module &m, const dialect &syntax) {
+
+	const auto &h = m.h;
+	const auto begin = m.begin;
+	const auto end = m.end;
+	const auto end_code = m.end_code;
+	const auto end_immediate = m.end_immediate;
+	auto iter = begin;
+
+	// one per thread, reused for every module.
+	static thread_local omm_disassembler d;
+	d.reset(m, syntax);
+
+	decode_counter counter;
+	block_counter blocks;
+	static_observers<decode_counter, block_counter> observers(counter, blocks);
+	if (flag_v) d.subscribe(&observers);
+
+
+	d.set_pc(h.org);
+	d.set_m(false);
+	d.set_x(false);
+	d.set_cpu(flag_t);
+
+	for (const auto &x : syntax.cpu) emit_directive(d, x[0], x[1] ? x[1] : "");
+	for (const auto &x : syntax.modes(false, false)) d.emit("", x.first, x.second);
+	emit_directive(d, syntax.options[0], syntax.options[1] ? syntax.options[1] : "");
+	emit_directive(d, syntax.org, d.to_x(h.org, 4, '$'));
+	put("");
+
+	emit_directive(d, syntax.proc);
+
+
+	comment(syntax, "*------------------------------*");
+	comment(syntax, "*        Header Section        *");
+	comment(syntax, "*------------------------------*");
+	put("");
+
+	auto word = [&](const std::string &expr, const std::string &comment){
+		auto l = syntax.data(2, expr);
+		d.emit("", l.first, l.second, comment);
+	};
+
+	word(d.to_x(h.version,4,'$'), "version");
+
+	if (isprint(h.id & 0xff) && isprint(h.id >> 8)) {
+		std::string tmp;
+		tmp.push_back('\'');
+		tmp.push_back(h.id & 0xff);
+		tmp.push_back(h.id >> 8);
+		tmp.push_back('\'');
+		// only mpw takes a 2 character word constant.
+		if (syntax.text_style == dialect::single_quote) word(tmp, "id");
+		else word(d.to_x(h.id,4,'$'), "id " + tmp);
+	}
+	else { 
+		word(d.to_x(h.id,4,'$'), "id");
+	}
+
+	word("end-start", "size " + d.to_x(h.size,4,'$'));
+	word(d.to_x(h.org,4,'$'), "org");
+	if (h.amperct) {
+		word(d.to_x(h.amperct,4,'_'), "ampersand table");
+	} else {
+	word(d.to_x(h.amperct,4,'$'), "ampersand table");
+
+	}
+	word(d.to_x(h.kind,4,'$'), "kind");
+	word(d.to_x(h.res1,4,'$'), "reserved");
+	word(d.to_x(h.res2,4,'$'), "reserved");
+
+
+	banner(syntax, "*         Code Section         *");
+
+	d.mark_line(h.org);
+	d.emit(syntax.label("start"));
+
+	for (iter = begin; iter != end_code; ++iter) {
+		d(*iter);
+	}
+
+	d.set_code(false);
+	// TODO -- v1 has 3 0 bytes.
+	if (iter != end) d(*iter++);
+	d.flush();
+
+	banner(syntax, "*       Immediate Section      *");
+
+	// word ptrs to data, terminated by word 0.
+
+
+
+	le_cursor c(iter, end_immediate);
+	for (uint16_t x; c.read(x); ) immediate_word(d, h, x);
+	iter = end_immediate;
+	// unterminated tables run to the end of the module.
+	if (le_view(iter, end).has(2)) {
+		d("0", 2);
+		iter += 2;
+	}
+	d.flush();
+
+
+	banner(syntax, "*         Data Section         *");
+
+	data_section free_form(m, d, iter);
+
+	if (h.amperct) {
+		auto xend = begin + (h.amperct - h.org);
+
+		while (free_form.position() < xend) {
+			free_form.next(xend);
+		}
+		d.set_code(false);
+		d.flush();
+
+		free_form.seek(ampersand_table(d, syntax, free_form.position(), end));
+	}
+
+	while (free_form.position() != end) {
+		free_form.next(end);
+	}
+	d.set_code(false);
+	d.flush();
+	put("");
+	d.mark_line(d.pc());
+	d.emit(syntax.label("end"));
+	emit_directive(d, syntax.end);
+	emit_directive(d, syntax.endp);
+
+	if (flag_v) {
+		d.unsubscribe(&observers);
+		decode_totals.listings++;
+		decode_totals.blocks += blocks.blocks;
+		decode_totals.events += blocks.items;
+		decode_totals.instructions += counter.instructions;
+		decode_totals.labels += counter.labels;
+		decode_totals.data += counter.data;
+	}
 }
 
 
-template<class T>
-void le_to_host(T &value) {
-	swap_if(value, std::integral_constant<bool, endian::native == endian::big>{});
+
+// labels to go back from a window.  A label the listing couldn't place
+// (inside an instruction or a data item) would throw the decode off,
+// but 6502 code falls back into step within a few instructions.
+static constexpr const unsigned kSyncLabels = 4;
+
+// the lines of the listing for [first, last).  Decoding starts where it
+// matches the full listing (the start of the section or a few labels
+// back) and the lines before first are dropped, so the cost is the
+// window plus the distance back to that point rather than the whole
+// module.
+static void render_window(const module &m, const dialect &syntax, uint32_t first, uint32_t last) {
+
+	const auto &h = m.h;
+	const auto begin = m.begin;
+	const auto end = m.end;
+	const auto end_code = m.end_code;
+
+	auto address = [&](const uint8_t *p) -> uint32_t { return h.org + (p - begin); };
+
+	// the sections, as render() walks them.
+	const auto immediate = end_code == end ? end : end_code + 1;
+	auto data = m.end_immediate;
+	if (le_view(data, end).has(2)) data += 2;
+	auto amperct = end;
+	auto amperct_end = end;
+	if (h.amperct && h.amperct >= h.org) {
+		amperct = std::max(data, begin + std::min<uint32_t>(h.amperct - h.org, h.size));
+		auto ff = (const uint8_t *)memchr(amperct, 0xff, end - amperct);
+		amperct_end = ff ? ff + 1 : end;
+	}
+
+	const auto p = begin + (first - h.org);
+	uint32_t floor;
+	bool labels = true;
+	bool code = false;
+
+	if (p < end_code) {
+		floor = h.org;
+		code = true;
+	}
+	else if (p < immediate) {
+		floor = address(end_code);
+		labels = false;
+	}
+	else if (p < data) {
+		// words from the start of the table.
+		floor = address(immediate) + ((first - address(immediate)) & ~1);
+		floor = std::min(floor, address(m.end_immediate));
+		labels = false;
+	}
+	else if (p >= amperct && p < amperct_end) {
+		floor = address(amperct);
+		labels = false;
+	}
+	else {
+		floor = address(p < amperct ? data : amperct_end);
+	}
+
+	uint32_t sync = floor;
+	if (labels) {
+		// descending, so the labels before first follow it.
+		auto iter = std::lower_bound(m.labels.begin(), m.labels.end(), first, std::greater<unsigned>());
+		for (unsigned back = kSyncLabels; iter != m.labels.end() && *iter > floor; ++iter) {
+			if (--back == 0) {
+				sync = *iter;
+				break;
+			}
+		}
+	}
+	if (sync >= address(data)) {
+		// jump tables are read a word at a time from the start.
+		for (const auto &t : m.jump_tables) {
+			if (sync > t.first && sync < t.second) sync = t.first + ((sync - t.first) & ~1);
+		}
+		// the listing only goes into a region at its start.
+		for (const auto &r : m.code_regions) {
+			if (r.begin >= address(data) && sync >= r.begin && sync < r.end) code = true;
+		}
+	}
+
+	// rendered to memory, then trimmed to the window.
+	char *buffer = nullptr;
+	size_t size = 0;
+	FILE *f = open_memstream(&buffer, &size);
+	if (!f) err(EX_OSERR, "open_memstream");
+	FILE *out = disassembler::output();
+	line_index index;
+	disassembler::set_output(f, &index);
+
+	static thread_local omm_disassembler d;
+	d.reset(m, syntax, sync, last);
+	d.set_m(false);
+	d.set_x(false);
+	d.set_cpu(flag_t);
+	d.set_code(code);
+	d.set_pc(sync);
+
+	auto iter = begin + (sync - h.org);
+	const auto stop = begin + (last - h.org);
+	auto done = [&](){ return d.pc() >= last; };
+
+	// each section runs on into the next until the window is done.
+	bool walk = false;
+
+	// starting at a section:  any label there, then the heading.
+	if (sync == address(immediate)) {
+		d.flush();
+		banner(syntax, "*       Immediate Section      *");
+		walk = true;
+	}
+	else if (sync == address(data)) {
+		d.flush();
+		banner(syntax, "*         Data Section         *");
+	}
+
+	if (iter <= end_code) {
+		while (iter != end_code && !done()) d(*iter++);
+		if (!done()) {
+			d.set_code(false);
+			if (iter != end) d(*iter++);
+			d.flush();
+			banner(syntax, "*       Immediate Section      *");
+			walk = true;
+		}
+	}
+
+	if ((walk || (iter >= immediate && iter < data)) && !done()) {
+		d.set_code(false);
+		le_cursor c(iter, m.end_immediate);
+		for (uint16_t x; !done() && c.read(x); ) immediate_word(d, h, x);
+		iter = c.position();
+		if (iter == m.end_immediate && iter != data && !done()) {
+			d("0", 2);
+			iter += 2;
+		}
+		if (!done()) {
+			d.flush();
+			banner(syntax, "*         Data Section         *");
+			walk = true;
+		}
+	}
+
+	if ((walk || iter >= data) && !done()) {
+		data_section free_form(m, d, iter);
+
+		while (free_form.position() < amperct && !done()) {
+			free_form.next(amperct, stop);
+		}
+		if (amperct != end && free_form.position() < amperct_end && !done()) {
+			d.set_code(false);
+			d.flush();
+			free_form.seek(ampersand_table(d, syntax, free_form.position(), end));
+		}
+		while (free_form.position() != end && !done()) {
+			free_form.next(end, stop);
+		}
+	}
+	// anything flushed after the window (eg, a partial block's cycles)
+	// isn't in the listing.
+	size_t to = done() ? index.offset() : SIZE_MAX;
+	d.set_code(false);
+	d.flush();
+
+	disassembler::set_output(out);
+	fclose(f);
+
+	// from the line holding first up to the first line at or after last.
+	size_t from = 0;
+	to = std::min(to, size);
+	bool found = false;
+	uint32_t best = 0;
+	for (const auto &e : index.entries()) {
+		if (e.address >= last) {
+			to = std::min<size_t>(to, e.offset);
+			break;
+		}
+		if (e.address <= first && (!found || e.address > best)) {
+			found = true;
+			best = e.address;
+			from = e.offset;
+		}
+	}
+	disassembler::write(buffer + from, to - from);
+	free(buffer);
 }
 
-template<class T>
-uint8_t read_8(T &iter) {
-	uint8_t tmp = *iter;
-	++iter;
-	return tmp;
+void disasm(const header &h, const uint8_t *data, unsigned flags, const std::vector<output> &outputs) {
+
+	module m;
+	analyze(m, h, data, flags);
+
+	render_all(outputs, [&](const dialect &syntax){
+		render(m, syntax);
+	});
 }
 
-template<class T>
-uint16_t read_16(T &iter) {
-	uint16_t tmp = 0;
 
-	tmp |= *iter << 0;
-	++iter;
-	tmp |= *iter << 8;
-	++iter;
-	return tmp;
+// IIgs load files.  Addresses are 24-bit and labels are kept in a
+// sparse bitmap rather than a vector/map.
+
+class omf_disassembler final : public disassembler {
+
+public:
+	omf_disassembler(const label_table &labels, uint32_t pc, const dialect &syntax);
+
+	~omf_disassembler() = default;
+
+protected:
+
+	virtual std::pair<std::string, std::string>
+	format_data(unsigned size, const uint8_t *data);
+
+	virtual std::pair<std::string, std::string>
+	format_data(unsigned size, const std::string &data);
+
+	virtual std::string ds() const;
+	virtual std::pair<std::string, std::string> format_fill(unsigned count, uint8_t value);
+
+	virtual int32_t next_label(int32_t pc);
+	virtual int32_t label_after(uint32_t address);
+
+	virtual std::string label_for_address(uint32_t address);
+
+private:
+	const label_table &_labels;
+	uint32_t _cursor;
+	const dialect &_syntax;
+};
+
+omf_disassembler::omf_disassembler(const label_table &labels, uint32_t pc, const dialect &syntax)
+	 : disassembler(syntax.traits | disassembler::track_rep_sep),
+	 _labels(labels), _cursor(pc), _syntax(syntax)
+{
+	set_pc(pc);
+	set_inline_params(nullptr);
+	recalc_next_label();
 }
 
-template<class T>
-uint32_t read_32(T &iter) {
-	uint32_t tmp = 0;
+std::pair<std::string, std::string>
+omf_disassembler::format_data(unsigned size, const uint8_t *data) {
+	return _syntax.data(1, hex_list(size, data));
+}
 
-	tmp |= *iter << 0;
-	++iter;
-	tmp |= *iter << 8;
-	++iter;
-	tmp |= *iter << 16;
-	++iter;
-	tmp |= *iter << 24;
-	++iter;
+std::pair<std::string, std::string>
+omf_disassembler::format_data(unsigned size, const std::string &data) {
+	return _syntax.data(size, data);
+}
 
+std::string omf_disassembler::ds() const { return _syntax.space_op; }
 
-	return tmp;
+std::pair<std::string, std::string>
+omf_disassembler::format_fill(unsigned count, uint8_t value) {
+	return _syntax.fill(count, to_x(value, 2, '$'));
 }
 
+int32_t omf_disassembler::next_label(int32_t pc) {
 
+	for(;;) {
+		int32_t address = _labels.next(_cursor);
+		if (address < 0 || pc == -1 || address > pc) return address;
 
-// header, opcodes, immediate table, data
-// opcodes end w/ 0 byte []
+		if (address == pc) emit(_syntax.label(to_x(address, 4, '_')));
+		else warnx("Unable to place label %s", to_x(address, 4, '_').c_str());
 
+		_cursor = address + 1;
+	}
+}
 
-void disasm(const std::string &path) {
-	std::error_code ec;
+int32_t omf_disassembler::label_after(uint32_t address) {
+	return _labels.next(address + 1);
+}
 
+std::string omf_disassembler::label_for_address(uint32_t address) {
+	if (_labels.test(address)) return to_x(address, 4, '_');
+	return "";
+}
+
+
+void disasm(const omf_file &omf, const std::vector<output> &outputs) {
+
+	const uint32_t kChunk = 4096;
+	label_table labels;
+
+	// relocated bytes of a segment, a chunk at a time, into buffer.
+	// DS spans (and reserved space) aren't read.
+	auto each_span = [&](const omf_file::segment &s, uint8_t *buffer, auto bytes, auto space){
+		for (const auto &span : s.spans) {
+			if (!span.data) {
+				space(span.offset, span.length);
+				continue;
+			}
+			for (uint32_t offset = 0; offset < span.length; offset += kChunk) {
+				uint32_t n = std::min(kChunk, span.length - offset);
+				omf.read(s, span.offset + offset, n, buffer);
+				bytes(span.offset + offset, n);
+			}
+		}
+	};
+
+	for (const auto &s : omf.segments()) {
+		labels.set(s.address);
+		if (s.entry) labels.set(s.address + s.entry);
+		if (!s.code()) continue;
+
+		analyzer anna(disassembler::track_rep_sep);
+		anna.set_inline_params(nullptr);
+		anna.set_pc(s.address);
+		anna.set_m(true);
+		anna.set_x(true);
+		std::vector<uint8_t> buffer(kChunk);
+		each_span(s, buffer.data(), [&](uint32_t, uint32_t n){
+			for (uint32_t i = 0; i < n; ++i) anna(buffer[i]);
+		}, [&](uint32_t offset, uint32_t n){
+			anna.set_pc(s.address + offset + n);
+		});
+
+		for (auto x : anna.finish()) {
+			// only labels within a segment.
+			for (const auto &t : omf.segments()) {
+				if (x >= t.address && x < t.address + t.length) {
+					labels.set(x);
+					break;
+				}
+			}
+		}
+	}
+
+	render_all(outputs, [&](const dialect &syntax){
+		std::vector<uint8_t> buffer(kChunk);
+		auto directive = [](const char *op, const std::string &operand = ""){
+			if (op) disassembler::emit("", op, operand);
+		};
+
+		for (const auto &x : syntax.cpu) directive(x[0], x[1] ? x[1] : "");
+		directive(syntax.options[0], syntax.options[1] ? syntax.options[1] : "");
+
+		for (const auto &s : omf.segments()) {
+
+			omf_disassembler d(labels, s.address, syntax);
+
+			put("");
+			comment(syntax, "*------------------------------*");
+			comment(syntax, ("* segment " + std::to_string(s.segnum) + ", kind " + d.to_x(s.kind, 4, '$')).c_str());
+			comment(syntax, ("* loaded at " + d.to_x(s.address, 6, '$')).c_str());
+			comment(syntax, "*------------------------------*");
+			put("");
+
+			d.set_m(true);
+			d.set_x(true);
+			d.set_cpu(flag_t);
+			for (const auto &x : syntax.modes(true, true)) d.emit("", x.first, x.second);
+			directive(syntax.org, d.to_x(s.address, 6, '$'));
+			const char *op = s.code() ? syntax.proc : syntax.record;
+			if (op) d.emit(s.name, op);
+			else d.emit(syntax.label(s.name));
+
+			d.set_code(s.code());
+
+			// DS spans are rendered as ds.b rather than 0s.
+			each_span(s, buffer.data(), [&](uint32_t, uint32_t n){
+				for (uint32_t i = 0; i < n; ++i) d(buffer[i]);
+			}, [&](uint32_t, uint32_t n){
+				d.space(n);
+			});
+
+			d.set_code(false);
+			d.flush();
+			put("");
+			directive(s.code() ? syntax.endp : syntax.endr);
+		}
+
+		put("");
+		directive(syntax.end);
+	});
+}
+
+
+// an OMM module or OMF load file.
+static bool disasm_module(const uint8_t *data, size_t size, unsigned flags, const std::vector<output> &outputs, std::string &error) {
+	header h;
+
+	if (read_header(data, size, h)) {
+		disasm(h, data, flags, outputs);
+		return true;
+	}
+
+	omf_file omf;
+	if (omf.open(data, size, error)) {
+		disasm(omf, outputs);
+		return true;
+	}
+	if (error.empty()) error = "not an OMM file.";
+	return false;
+}
+
+// modules in a ShrinkIt archive, expanded and rendered in parallel then
+// written in archive order.  Other files are skipped.
+static bool disasm(const nufx_archive &archive, unsigned flags, const std::vector<output> &outputs, std::string &error) {
+
+	const auto &records = archive.records();
+	// listings[record * outputs + output], empty if skipped.
+	std::vector<std::string> listings(records.size() * outputs.size());
+	// and their line indexes, relative to the listing.
+	std::vector<line_index> indexes(listings.size());
+	std::vector<std::string> errors(records.size());
+
+	parallel_for(records.size(), 0, [&](size_t i){
+		// reused for every record on this thread.
+		static thread_local nufx_archive::expander expander;
+		static thread_local std::vector<uint8_t> buffer;
+
+		if (!expander.expand(records[i], buffer, errors[i])) return;
+
+		std::vector<output> tmp;
+		std::vector<char *> buffers(outputs.size());
+		std::vector<size_t> sizes(outputs.size());
+		for (size_t j = 0; j < outputs.size(); ++j) {
+			FILE *f = open_memstream(&buffers[j], &sizes[j]);
+			if (!f) err(EX_OSERR, "open_memstream");
+			line_index *index = outputs[j].index ? &indexes[i * outputs.size() + j] : nullptr;
+			tmp.push_back({ outputs[j].syntax, f, index });
+		}
+
+		std::string e;
+		bool ok = disasm_module(buffer.data(), buffer.size(), flags, tmp, e);
+
+		for (size_t j = 0; j < outputs.size(); ++j) {
+			fclose(tmp[j].file);
+			if (ok) listings[i * outputs.size() + j].assign(buffers[j], sizes[j]);
+			free(buffers[j]);
+		}
+	});
+
+	bool found = false;
+	for (size_t i = 0; i < records.size(); ++i) {
+		if (!errors[i].empty()) warnx("%s: %s", records[i].name.c_str(), errors[i].c_str());
+
+		for (size_t j = 0; j < outputs.size(); ++j) {
+			const auto &listing = listings[i * outputs.size() + j];
+			if (listing.empty()) continue;
+			found = true;
+
+			disassembler::set_output(outputs[j].file, outputs[j].index);
+			if (i) put("");
+			comment(*outputs[j].syntax, "*------------------------------*");
+			comment(*outputs[j].syntax, ("* " + records[i].name).c_str());
+			comment(*outputs[j].syntax, "*------------------------------*");
+			put("");
+			if (outputs[j].index) outputs[j].index->append(indexes[i * outputs.size() + j]);
+			fwrite(listing.data(), 1, listing.size(), outputs[j].file);
+			disassembler::set_output(nullptr);
+		}
+	}
+
+	if (!found) error = "no OMM or OMF files in archive.";
+	return found;
+}
+
+// an OMM module, OMF load file or ShrinkIt archive.
+bool disasm(const uint8_t *data, size_t size, unsigned flags, const std::vector<output> &outputs, std::string &error) {
+
+	nufx_archive archive;
+	if (archive.open(data, size, error)) return disasm(archive, flags, outputs, error);
+	if (!error.empty()) return false;
+
+	return disasm_module(data, size, flags, outputs, error);
+}
+
+void disasm(const std::string &path, const std::vector<output> &outputs) {
+	std::error_code ec;
+	std::string error;
 
 	mapped_file mf(path, ec);
 	if (ec) {
 		errx(1, "%s: %s", path.c_str(), ec.message().c_str());
 	}
 
-	if (mf.size() < 16 + 3) {
-		errx(1, "%s: not an OMM file.", path.c_str());
+	if (!disasm(mf.data(), mf.size(), analyze_flags(), outputs, error)) {
+		errx(1, "%s: %s", path.c_str(), error.c_str());
 	}
+}
+
+// just the lines for [first, last) of an OMM module.
+bool disasm_window(const uint8_t *data, size_t size, unsigned flags, const std::vector<output> &outputs, uint32_t first, uint32_t last, std::string &error) {
 
 	header h;
-	h = *(header *)mf.data();
+	if (!read_header(data, size, h)) {
+		error = "not an OMM file.";
+		return false;
+	}
 
-	le_to_host(h.version);
-	le_to_host(h.id);
-	le_to_host(h.size);
-	le_to_host(h.org);
-	le_to_host(h.amperct);
-	le_to_host(h.kind);
-	le_to_host(h.res1);
-	le_to_host(h.res2);
+	uint32_t end = h.org + h.size;
+	if (first >= end || last <= h.org) {
+		error = disassembler::to_x(first, 4, '$');
+		if (last - first > 1) error += "-" + disassembler::to_x(last - 1, 4, '$');
+		error += " is outside the module (" + disassembler::to_x(h.org, 4, '$') + "-" + disassembler::to_x(end - 1, 4, '$') + ").";
+		return false;
+	}
+	first = std::max<uint32_t>(first, h.org);
+	last = std::min(last, end);
 
+	module m;
+	analyze(m, h, data, flags);
 
-	// sanity check the header fields....
+	render_all(outputs, [&](const dialect &syntax){
+		render_window(m, syntax, first, last);
+	});
+	return true;
+}
 
-	if (h.res1 || h.res2 || h.kind) {
-		errx(1, "%s: not an OMM file.", path.c_str());
-	}
+// address[,bytes] ($hex, 0xhex or decimal):  the item at address and
+// anything within bytes either side.
+static bool parse_window(const std::string &s, uint32_t &first, uint32_t &last) {
 
-	if (h.version > 1 || h.size + 16 != mf.size()) {
-		errx(1, "%s: not an OMM file.", path.c_str());
+	auto number = [](const std::string &s, unsigned long &x){
+		const char *xp = s.c_str();
+		int base = 10;
+		if (*xp == '$') { ++xp; base = 16; }
+		else if (xp[0] == '0' && tolower(xp[1]) == 'x') { xp += 2; base = 16; }
+
+		char *end;
+		x = strtoul(xp, &end, base);
+		return *xp && !*end && x <= 0xffffff;
+	};
+
+	unsigned long address;
+	unsigned long bytes = 0;
+	auto comma = s.find(',');
+	if (!number(s.substr(0, comma), address)) return false;
+	if (comma != s.npos && !number(s.substr(comma + 1), bytes)) return false;
+
+	first = address > bytes ? address - bytes : 0;
+	last = address + bytes + 1;
+	return true;
+}
+
+void at(const std::string &path, const std::vector<output> &outputs, uint32_t first, uint32_t last) {
+	std::error_code ec;
+	std::string error;
+
+	mapped_file mf(path, ec);
+	if (ec) {
+		errx(1, "%s: %s", path.c_str(), ec.message().c_str());
 	}
 
-	if (h.amperct && h.amperct >= h.size + h.org) {
-		errx(1, "%s: not an OMM file.", path.c_str());
+	if (!disasm_window(mf.data(), mf.size(), analyze_flags(), outputs, first, last, error)) {
+		errx(1, "%s: %s", path.c_str(), error.c_str());
 	}
+}
 
-	if (h.amperct && h.amperct <= h.org) {
-		errx(1, "%s: not an OMM file.", path.c_str());
+// many files: read, analyze and render on separate threads (connected
+// by bounded queues) so I/O, decoding and formatting overlap.  Listings
+// and errors still come out in order.  Finished jobs go back to the
+// reader so each module's vectors are reused rather than reallocated.
+struct batch_job {
+	std::string path;
+	std::error_code ec;
+	std::unique_ptr<mapped_file> mf;
+	header h;
+	bool omm = false;
+	module m;
+
+	void open(const std::string &p) {
+		path = p;
+		ec.clear();
+		mf.reset(new mapped_file(p, ec));
+		omm = !ec && read_header(mf->data(), mf->size(), h);
 	}
+};
 
+static void disasm_batch(int argc, char **argv, const std::vector<output> &outputs) {
 
+	typedef std::unique_ptr<batch_job> job_ptr;
+	typedef std::chrono::duration<double> seconds;
 
-	std::vector<unsigned> labels;
-	std::pair<unsigned, unsigned> address_space = std::make_pair(h.org, h.org + h.size);
-	std::pair<unsigned, unsigned> code_address_space;
-	std::pair<unsigned, unsigned> data_address_space;
-	std::pair<unsigned, unsigned> immediate_address_space;
+	const unsigned flags = analyze_flags();
+	spsc_queue<job_ptr> read_queue(16);
+	spsc_queue<job_ptr> analyze_queue(16);
+	spsc_queue<job_ptr> spare_queue(64);
+	std::atomic<bool> stop(false);
 
+	std::thread reader([&](){
+		for (int i = 0; i < argc && !stop; ++i) {
+			job_ptr j;
+			if (!spare_queue.try_pop(j)) j.reset(new batch_job);
+			j->open(argv[i]);
+			read_queue.push(std::move(j));
+		}
+		read_queue.close();
+	});
 
+	std::thread analysis([&](){
+		job_ptr j;
+		while (read_queue.pop(j)) {
+			if (j->omm && !stop) analyze(j->m, j->h, j->mf->data(), flags);
+			analyze_queue.push(std::move(j));
+		}
+		analyze_queue.close();
+	});
 
+	// the first error stops the other threads.  They're joined before
+	// errx since exit() destroys statics they may still be using.
+	std::string failure;
+	job_ptr j;
+	while (analyze_queue.pop(j)) {
+		std::string error;
+
+		if (!failure.empty()) ;
+		else if (j->ec) failure = j->path + ": " + j->ec.message();
+		else if (j->omm) {
+			render_all(outputs, [&](const dialect &syntax){
+				render(j->m, syntax);
+			});
+		}
+		else if (!disasm(j->mf->data(), j->mf->size(), flags, outputs, error)) {
+			failure = j->path + ": " + error;
+		}
+		if (!failure.empty()) stop = true;
 
-	const auto begin = mf.begin() + 16;
-	const auto end = mf.end();
+		j->mf.reset();
+		spare_queue.try_push(j);
+		j.reset();
+	}
 
-	auto end_code = mf.end();
-	auto end_immediate = mf.end();
-	//auto end_data = mf.end();
+	reader.join();
+	analysis.join();
+
+	if (!failure.empty()) errx(1, "%s", failure.c_str());
+
+	if (flag_v) {
+		auto a = read_queue.statistics();
+		auto b = analyze_queue.statistics();
+		auto mean = [](const spsc_queue<job_ptr>::stats &s){
+			return s.items ? (double)s.total_depth / s.items : 0.0;
+		};
+
+		fprintf(stderr, "read:     %zu files, %.3fs stalled (queue full)\n",
+			a.items, seconds(a.push_stall).count());
+		fprintf(stderr, "analyze:  %.3fs waiting, %.3fs stalled, queue max %zu/%zu, mean %.1f\n",
+			seconds(a.pop_stall).count(), seconds(b.push_stall).count(),
+			a.max_depth, read_queue.capacity(), mean(a));
+		fprintf(stderr, "render:   %.3fs waiting, queue max %zu/%zu, mean %.1f\n",
+			seconds(b.pop_stall).count(), b.max_depth, analyze_queue.capacity(), mean(b));
+	}
+}
 
-	code_address_space.first = h.org;	
+// daemon requests:
+// disasm [-ce] path
+// data [-ce] length
+bool serve_request(const request &r, FILE *out, std::string &error) {
 
-	analyzer anna;
-	anna.set_m(false);
-	anna.set_x(false);
-	anna.set_pc(h.org);
+	unsigned flags = 0;
+	std::vector<std::string> operands;
 
-	auto iter = begin;
-	for ( ; iter != end; ++iter) {
-		uint8_t op = *iter;
-		if (op == 0 && anna.state()) {
-			// version 1 requires 3 0s to terminate code.
-			if (h.version == 0 || (anna.op() == 0 && anna.arg() == 0)) {
-				end_code = iter;
-				++iter;
-				break;
+	for (size_t i = 1; i < r.args.size(); ++i) {
+		const auto &arg = r.args[i];
+		if (arg.size() < 2 || arg.front() != '-') {
+			operands.push_back(arg);
+			continue;
+		}
+		for (char c : arg.substr(1)) {
+			switch(c) {
+				case 'c': flags |= analyze_classify; break;
+				case 'e': flags |= analyze_emulate; break;
+				default:
+					error = "bad option -" + std::string(1, c);
+					return false;
 			}
 		}
-		anna(op);
 	}
 
-	labels = anna.finish();
-	erase_if(labels, [&address_space](uint32_t x){
-		return x < address_space.first || x > address_space.second;
-	});
-
-	if (h.amperct) labels.push_back(h.amperct);
+	const auto &command = r.args.front();
+	const std::vector<output> outputs = { { &dialect::standard(), out } };
+	const char *usage = "usage: disasm [-ce] path [address[,bytes]] | data [-ce] [address[,bytes]] length";
+	bool ok = false;
+
+	// a trailing address[,bytes] asks for just that window.
+	uint32_t first = 0;
+	uint32_t last = 0;
+	size_t files = command == "disasm" ? 1 : 0;
+	if (operands.size() == files + 1) {
+		if (!parse_window(operands.back(), first, last)) {
+			error = "bad address " + operands.back();
+			return false;
+		}
+		operands.pop_back();
+	}
+	auto render = [&](const uint8_t *data, size_t size){
+		if (last) return disasm_window(data, size, flags, outputs, first, last, error);
+		return disasm(data, size, flags, outputs, error);
+	};
 
-	unsigned offset = std::distance(begin, iter) + h.org;
+	if (command == "data" && operands.empty()) {
+		ok = render(r.data.data(), r.data.size());
+	} else if (command == "disasm" && operands.size() == 1) {
+		std::error_code ec;
+		mapped_file mf(operands.front(), ec);
+		if (ec) error = operands.front() + ": " + ec.message();
+		else ok = render(mf.data(), mf.size());
+	} else {
+		error = usage;
+	}
+	return ok;
+}
 
-	code_address_space.second = offset - 1;
-	immediate_address_space.first = offset;
+void scan(const std::string &path) {
+	std::error_code ec;
 
-	// immediate table (keep references)
-	for (; iter != end; offset += 2) {
-		auto x = read_16(iter);
-		if (x == 0) {
-			end_immediate = iter - 2;
-			break;
-		}
-		if (x >= address_space.first && x < address_space.second) labels.push_back(x);
-		//labels.push_back(offset);
+	mapped_file mf(path, ec);
+	if (ec) {
+		errx(1, "%s: %s", path.c_str(), ec.message().c_str());
 	}
 
-	immediate_address_space.second = offset - 2;
-	// data!
+	for (auto offset : scanner(mf.data(), mf.size()).scan()) {
+		header h;
 
-	data_address_space.first = offset;
-	data_address_space.second = h.org + h.size;
+		read_header(mf.data() + offset, mf.size() - offset, h, false);
 
-	std::sort(labels.begin(), labels.end(), std::greater<unsigned>());
-	labels.erase(std::unique(labels.begin(), labels.end()), labels.end());
+		printf("%s: $%08zx: version %u, id $%04x, size $%04x, org $%04x, ampersand table $%04x\n",
+			path.c_str(), offset, h.version, h.id, h.size, h.org, h.amperct);
 
-	omm_disassembler d(labels);
+		if (flag_d) {
+			puts("");
+			disasm(h, mf.data() + offset, analyze_flags(), { { flag_f, stdout } });
+			puts("");
+		}
+	}
+}
 
-	d.set_pc(h.org);
-	d.set_m(false);
-	d.set_x(false);
+void link(int argc, char **argv) {
 
-	d.emit("","longa", "off");
-	d.emit("","longi", "off");
-	d.emit("","case", "on");
-	puts("");
+	std::deque<mapped_file> files;
+	symbol_index index;
 
-	d.emit("","proc");
+	for (int i = 0; i < argc; ++i) {
+		std::error_code ec;
+		header h;
+		std::string path(argv[i]);
+
+		files.emplace_back(path, ec);
+		const auto &mf = files.back();
+		if (ec) {
+			errx(1, "%s: %s", path.c_str(), ec.message().c_str());
+		}
+
+		if (!read_header(mf.data(), mf.size(), h)) {
+			errx(1, "%s: not an OMM file.", path.c_str());
+		}
+		index.add(path, h, mf.data());
+	}
 
+	index.build();
+	index.resolve();
+	index.report();
+}
 
-	puts("*------------------------------*");
-	puts("*        Header Section        *");
-	puts("*------------------------------*");
-	puts("");
+// $e0 zfree1, $f0-$f3, ... (named bytes aren't merged into ranges)
+static std::string zp_list(const std::bitset<256> &bytes) {
+	std::string rv;
 
-	d.emit("", "dc.w", d.to_x(h.version,4,'$'), "version");
+	for (unsigned i = 0; i < 256; ++i) {
+		if (!bytes[i]) continue;
+		unsigned j = i;
+		if (!zp_name(i)) while (j < 255 && bytes[j + 1] && !zp_name(j + 1)) ++j;
 
-	if (isprint(h.id & 0xff) && isprint(h.id >> 8)) {
-		std::string tmp;
-		tmp.push_back('\'');
-		tmp.push_back(h.id & 0xff);
-		tmp.push_back(h.id >> 8);
-		tmp.push_back('\'');
-		d.emit("","dc.w", tmp, "id");
-	}
-	else { 
-		d.emit("", "dc.w", d.to_x(h.id,4,'$'), "id");
+		if (!rv.empty()) rv += ", ";
+		rv += disassembler::to_x(i, 2, '$');
+		if (j > i) rv += "-" + disassembler::to_x(j, 2, '$');
+		else if (zp_name(i)) rv += std::string(" ") + zp_name(i);
+		i = j;
 	}
+	return rv;
+}
 
-	d.emit("", "dc.w", "end-start", "size " + d.to_x(h.size,4,'$'));
-	d.emit("", "dc.w", d.to_x(h.org,4,'$'), "org");
-	if (h.amperct) {
-		d.emit("", "dc.w", d.to_x(h.amperct,4,'_'), "ampersand table");
-	} else {
-	d.emit("", "dc.w", d.to_x(h.amperct,4,'$'), "ampersand table");
+void zero_page(int argc, char **argv) {
 
+	std::deque<mapped_file> files;
+	zp_index index;
+
+	for (int i = 0; i < argc; ++i) {
+		std::error_code ec;
+		header h;
+		std::string path(argv[i]);
+
+		files.emplace_back(path, ec);
+		const auto &mf = files.back();
+		if (ec) {
+			errx(1, "%s: %s", path.c_str(), ec.message().c_str());
+		}
+
+		if (!read_header(mf.data(), mf.size(), h)) {
+			errx(1, "%s: not an OMM file.", path.c_str());
+		}
+		index.add(path, h, mf.data());
 	}
-	d.emit("", "dc.w", d.to_x(h.kind,4,'$'), "kind");
-	d.emit("", "dc.w", d.to_x(h.res1,4,'$'), "reserved");
-	d.emit("", "dc.w", d.to_x(h.res2,4,'$'), "reserved");
 
+	index.build(analyze_flags());
+	const auto &modules = index.modules();
 
-	puts("");
 	puts("*------------------------------*");
-	puts("*         Code Section         *");
+	puts("*          Zero Page           *");
 	puts("*------------------------------*");
 	puts("");
 
-	d.emit("start");
+	for (const auto &e : modules) {
+		// read only, and written (which may also be read).
+		const auto reads = e.reads & ~e.writes;
 
-	for (iter = begin; iter != end_code; ++iter) {
-		d(*iter);
+		printf("%s\n", e.name.c_str());
+		if (reads.any()) printf("        read   %s\n", zp_list(reads).c_str());
+		if (e.writes.any()) printf("        write  %s\n", zp_list(e.writes).c_str());
 	}
 
-	d.set_code(false);
-	// TODO -- v1 has 3 0 bytes.
-	d(*iter++);
-	d.flush();
-
 	puts("");
 	puts("*------------------------------*");
-	puts("*       Immediate Section      *");
+	puts("*          Conflicts           *");
 	puts("*------------------------------*");
 	puts("");
 
-	// word ptrs to data, terminated by word 0.
+	for (const auto &c : index.conflicts()) {
+		printf("%s: %s: %s\n", modules[c.a].name.c_str(), modules[c.b].name.c_str(),
+			zp_list(c.bytes).c_str());
+	}
+}
 
+static std::string routine_name(const module &m, uint32_t address) {
+	if (address == m.h.org) return std::string("start");
+	const auto &map = symbol_map();
+	auto iter = map.find(address);
+	if (iter != map.end()) return iter->second;
+	auto name = signature_name(m.names, address);
+	if (name) return *name;
+	return disassembler::to_x(address, 4, '_');
+}
 
+void calls(const std::string &path, const std::string &format) {
+	std::error_code ec;
+	header h;
+	module m;
 
-	for ( ; iter != end_immediate; ) {
-		auto x = read_16(iter);
-		std::string tmp;
-		if (x < h.org) tmp = d.to_x(x, 4,'$');
-		else tmp = d.to_x(x, 4, '_');
-		d(tmp, 2, x);
+	mapped_file mf(path, ec);
+	if (ec) {
+		errx(1, "%s: %s", path.c_str(), ec.message().c_str());
 	}
-	d("0", 2);
-	d.flush();
-	iter += 2;
 
+	if (!read_header(mf.data(), mf.size(), h)) {
+		errx(1, "%s: not an OMM file.", path.c_str());
+	}
 
-	puts("");
-	puts("*------------------------------*");
-	puts("*         Data Section         *");
-	puts("*------------------------------*");
-	puts("");
+	analyze(m, h, mf.data(), analyze_flags());
 
-	// free-form data (may include code!)
+	call_graph g;
+	g.build(m);
 
-	if (h.amperct) {
-		auto xend = begin + (h.amperct - h.org);
+	auto name = [&](uint32_t address){ return routine_name(m, address); };
 
-		for (; iter != xend; ++iter) {
-			d(*iter);
+	if (format == "dot") g.write_dot(stdout, name);
+	else if (format == "json") g.write_json(stdout, name);
+	else {
+		printf("%s\n", path.c_str());
+		g.write_text(stdout, name);
+	}
+}
+
+void index_blocks(const std::string &index_path, int argc, char **argv) {
+
+	std::deque<mapped_file> files;
+	block_corpus corpus;
+
+	for (int i = 0; i < argc; ++i) {
+		std::error_code ec;
+		header h;
+		std::string path(argv[i]);
+
+		files.emplace_back(path, ec);
+		const auto &mf = files.back();
+		if (ec) {
+			errx(1, "%s: %s", path.c_str(), ec.message().c_str());
 		}
-		d.flush();
 
-		// custom parser for the ampersand table.
+		if (!read_header(mf.data(), mf.size(), h)) {
+			errx(1, "%s: not an OMM file.", path.c_str());
+		}
+		corpus.add(path, h, mf.data());
+	}
 
-		std::string tmp;
-		unsigned pc = d.pc();
-		puts("");
-		d.emit("amperct");
+	corpus.build(analyze_flags());
+	if (!corpus.write(index_path)) exit(EX_CANTCREAT);
+}
 
-		// usually token, 0 or 'text', 0
-		// but could include: 
-		// ON 'HANGUP' GOTO
+void similar(const std::string &index_path, int argc, char **argv) {
 
-		bool quoted = false;
+	std::error_code ec;
+	block_index index;
 
-		for (; iter != end; ++iter, ++pc) {
-			uint8_t c= *iter;
-			if (isascii(c) && isprint(c)) {
-				if (!quoted) { tmp.push_back('\''); quoted = true; }
-				tmp.push_back(c);
-				continue;
-			}
+	mapped_file imf(index_path, ec);
+	if (ec) {
+		errx(1, "%s: %s", index_path.c_str(), ec.message().c_str());
+	}
+	if (!index.open(imf.data(), imf.size())) {
+		errx(1, "%s: not a block index.", index_path.c_str());
+	}
 
-			if (!tmp.empty()) {
-				if (quoted) {
-					quoted = false;
-					tmp.push_back('\'');
-					tmp += ", ";
-				}
+	for (int i = 0; i < argc; ++i) {
+		header h;
+		module m;
+		std::string path(argv[i]);
 
-				if (c == 0x00) {
-					tmp += "0";
-					d.emit("","dc.b", tmp);
-					tmp.clear();
-					continue;
-				}
-			}
+		mapped_file mf(path, ec);
+		if (ec) {
+			errx(1, "%s: %s", path.c_str(), ec.message().c_str());
+		}
+		if (!read_header(mf.data(), mf.size(), h)) {
+			errx(1, "%s: not an OMM file.", path.c_str());
+		}
 
-			if (c >= 0x80 && c <= 0xea) {
-				tmp += tokens[c - 0x80];
-				tmp += ", ";
-				continue;
+		analyze(m, h, mf.data(), analyze_flags());
+
+		printf("%s\n", path.c_str());
+		for (const auto &r : routine_hashes(m)) {
+			auto matches = index.query(r);
+			// not itself.
+			erase_if(matches, [&](const block_index::match &x){
+				return x.address == r.address && index.module_name(x.module) == path;
+			});
+			if (matches.empty()) continue;
+
+			printf("    %s (%u blocks)\n", routine_name(m, r.address).c_str(), r.blocks);
+			for (const auto &x : matches) {
+				printf("        %.2f  %s %s (%u blocks)\n", x.similarity,
+					index.module_name(x.module).c_str(),
+					disassembler::to_x(x.address, 4, '_').c_str(), x.blocks);
 			}
+		}
+	}
+}
+
+int diff(const std::string &old_path, const std::string &new_path) {
+
+	std::error_code ec;
+	header ha, hb;
+	module ma, mb;
+
+	mapped_file a(old_path, ec);
+	if (ec) {
+		errx(1, "%s: %s", old_path.c_str(), ec.message().c_str());
+	}
+	mapped_file b(new_path, ec);
+	if (ec) {
+		errx(1, "%s: %s", new_path.c_str(), ec.message().c_str());
+	}
+
+	if (!read_header(a.data(), a.size(), ha)) {
+		errx(1, "%s: not an OMM file.", old_path.c_str());
+	}
+	if (!read_header(b.data(), b.size(), hb)) {
+		errx(1, "%s: not an OMM file.", new_path.c_str());
+	}
+
+	analyze(ma, ha, a.data(), analyze_flags());
+	analyze(mb, hb, b.data(), analyze_flags());
+
+	// like diff(1), 1 if there are differences.
+	return diff(old_path, ma, new_path, mb) ? 1 : 0;
+}
+
+int main(int argc, char **argv) {
+
+	int c;
+	std::string daemon_socket;
+	std::string call_format;
+	std::string index_path;
+	std::string similar_path;
+	std::vector<output> outputs;
+	std::vector<std::string> output_paths;
+	bool flag_line_index = false;
+	std::string window;
+
+	static struct option long_options[] = {
+		{ "diff", no_argument, nullptr, 'D' },
+		{ "daemon", required_argument, nullptr, 'S' },
+		{ "call-graph", required_argument, nullptr, 'G' },
+		{ "index", required_argument, nullptr, 'I' },
+		{ "similar", required_argument, nullptr, 'M' },
+		{ "line-index", no_argument, nullptr, 'X' },
+		{ "at", required_argument, nullptr, 'A' },
+		{ nullptr, 0, nullptr, 0 },
+	};
 
-			d.emit("", "dc.b", d.to_x(c, 2, '$'));
-			if (c == 0xff) {
-				++pc;
-				++iter;
+	while ((c = getopt_long(argc, argv, "cdesvxzf:o:t:L:n:", long_options, nullptr)) != -1) {
+		switch(c) {
+			case 'L':
+				if (!load_symbols(optarg, inline_params::standard(), user_symbols))
+					exit(EX_DATAERR);
+				break;
+			case 'n':
+				if (!load_signatures(optarg, signature_set::standard()))
+					exit(EX_DATAERR);
+				break;
+			case 'c': flag_c = true; break;
+			case 'd': flag_d = true; break;
+			case 'e': flag_e = true; break;
+			case 's': flag_s = true; break;
+			case 'x': flag_x = true; break;
+			case 'v': flag_v = true; break;
+			case 'z': flag_z = true; break;
+			case 'D': flag_diff = true; break;
+			case 'S': daemon_socket = optarg; break;
+			case 'I': index_path = optarg; break;
+			case 'M': similar_path = optarg; break;
+			case 'X': flag_line_index = true; break;
+			case 'A': window = optarg; break;
+			case 'G':
+				call_format = optarg;
+				if (call_format != "text" && call_format != "dot" && call_format != "json")
+					errx(EX_USAGE, "%s: expected text, dot or json.", optarg);
+				break;
+			case 't':
+				flag_t = parse_cpu(optarg);
+				if (!flag_t) errx(EX_USAGE, "%s: expected 6502, 65c02 or 65816.", optarg);
+				break;
+			case 'f':
+				flag_f = dialect::find(optarg);
+				if (!flag_f) errx(EX_USAGE, "%s: unknown dialect.", optarg);
+				break;
+			case 'o': {
+				// dialect:path, opened once the arguments check out.
+				std::string arg(optarg);
+				auto colon = arg.find(':');
+				const dialect *d = dialect::find(arg.substr(0, colon));
+				if (colon == arg.npos || colon + 1 == arg.size() || !d)
+					errx(EX_USAGE, "%s: expected dialect:path.", optarg);
+				outputs.push_back({ d, nullptr });
+				output_paths.push_back(arg.substr(colon + 1));
 				break;
 			}
+			default:
+				fputs("usage: omm_disassembler [-cev] [-t cpu] [-f dialect] [-o dialect:path] [--line-index] [-L symbols] [-n signatures] file ...\n", stderr);
+				fputs("       omm_disassembler --at address[,bytes] [-ce] [-t cpu] [-f dialect] [-o dialect:path] [-L symbols] file\n", stderr);
+				fputs("       omm_disassembler -s [-cde] [-L symbols] file ...\n", stderr);
+				fputs("       omm_disassembler -x [-L symbols] file ...\n", stderr);
+				fputs("       omm_disassembler -z [-ce] file ...\n", stderr);
+				fputs("       omm_disassembler --diff [-ce] [-L symbols] old new\n", stderr);
+				fputs("       omm_disassembler --call-graph text|dot|json [-ce] [-L symbols] [-n signatures] file ...\n", stderr);
+				fputs("       omm_disassembler --index index [-ce] file ...\n", stderr);
+				fputs("       omm_disassembler --similar index [-ce] [-L symbols] [-n signatures] file ...\n", stderr);
+				fputs("       omm_disassembler --daemon socket [-L symbols]\n", stderr);
+				exit(EX_USAGE);
 		}
+	}
+	argc -=optind;
+	argv += optind;
 
+	if (!daemon_socket.empty()) {
+		serve(daemon_socket, 0, serve_request);
+		return 0;
+	}
 
-		puts("");
-		d.set_pc(pc);
+	if (flag_x) {
+		link(argc, argv);
+		return 0;
 	}
 
+	if (flag_z) {
+		zero_page(argc, argv);
+		return 0;
+	}
 
-	for (; iter != end; ++iter) {
-		d(*iter);
+	if (!index_path.empty()) {
+		index_blocks(index_path, argc, argv);
+		return 0;
 	}
-	d.flush();
-	puts("");
-	d.emit("end");
-	d.emit("","end");
-	d.emit("","endp");
 
-}
+	if (!similar_path.empty()) {
+		similar(similar_path, argc, argv);
+		return 0;
+	}
 
+	if (!call_format.empty()) {
+		for (int i = 0; i < argc; ++i) calls(argv[i], call_format);
+		return 0;
+	}
 
-int main(int argc, char **argv) {
+	if (flag_diff) {
+		if (argc != 2) {
+			fputs("usage: omm_disassembler --diff [-ce] [-L symbols] old new\n", stderr);
+			exit(EX_USAGE);
+		}
+		return diff(argv[0], argv[1]);
+	}
 
-	int c;
+	uint32_t first = 0;
+	uint32_t last = 0;
+	if (!window.empty()) {
+		if (!parse_window(window, first, last)) errx(EX_USAGE, "%s: expected address[,bytes].", window.c_str());
+		if (flag_s || argc != 1) errx(EX_USAGE, "--at requires a single file.");
+	}
 
-	while ((c = getopt(argc, argv, "")) != -1) {
+	if (!outputs.empty() && (flag_s || argc != 1)) {
+		errx(EX_USAGE, "-o requires a single file.");
+	}
 
+	// path.idx beside each -o listing.
+	std::vector<line_index> indexes(outputs.size());
+	if (flag_line_index) {
+		if (outputs.empty()) errx(EX_USAGE, "--line-index requires -o.");
+		for (size_t i = 0; i < outputs.size(); ++i) outputs[i].index = &indexes[i];
 	}
-	argc -=optind;
-	argv += optind;
+	for (size_t i = 0; i < outputs.size(); ++i) {
+		outputs[i].file = fopen(output_paths[i].c_str(), "w");
+		if (!outputs[i].file) err(EX_CANTCREAT, "%s", output_paths[i].c_str());
+	}
+	outputs.insert(outputs.begin(), { flag_f, stdout });
 
-	for (int i = 0; i < argc; ++i) {
-		disasm(argv[i]);
+	if (flag_s) {
+		for (int i = 0; i < argc; ++i) scan(argv[i]);
+	}
+	else if (last) at(argv[0], outputs, first, last);
+	else if (argc > 1) disasm_batch(argc, argv, outputs);
+	else if (argc == 1) disasm(argv[0], outputs);
+
+	for (size_t i = 1; i < outputs.size(); ++i) {
+		if (fclose(outputs[i].file) != 0) err(EX_IOERR, "fclose");
+	}
+	if (flag_v && decode_totals.listings) {
+		const auto &t = decode_totals;
+		fprintf(stderr, "decode:   %zu listings, %zu blocks (%.1f events each), %zu instructions, %zu labels, %zu data bytes\n",
+			t.listings.load(), t.blocks.load(), (double)t.events / std::max<size_t>(t.blocks, 1),
+			t.instructions.load(), t.labels.load(), t.data.load());
+	}
+	if (flag_line_index) {
+		for (size_t i = 0; i < indexes.size(); ++i) {
+			if (!indexes[i].write(output_paths[i] + ".idx")) exit(EX_IOERR);
+		}
 	}
 	return 0;
 }
@@ -0,0 +1,38 @@
+#ifndef __parallel_h__
+#define __parallel_h__
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+// call f(i) for i in [0, n) on up to threads threads (0 = one per core).
+// work is handed out one index at a time so uneven items balance out.
+
+template<class F>
+void parallel_for(size_t n, unsigned threads, F f) {
+
+	if (!threads) threads = std::thread::hardware_concurrency();
+	threads = std::min<size_t>(threads, n);
+
+	if (threads <= 1) {
+		for (size_t i = 0; i < n; ++i) f(i);
+		return;
+	}
+
+	std::atomic<size_t> next(0);
+	std::vector<std::thread> pool;
+
+	for (unsigned i = 0; i < threads; ++i) {
+		pool.emplace_back([&](){
+			for(;;) {
+				size_t j = next++;
+				if (j >= n) break;
+				f(j);
+			}
+		});
+	}
+	for (auto &t : pool) t.join();
+}
+
+#endif
@@ -0,0 +1,85 @@
+// zp but called as jsr $00xx
+_(0xb1, chrget)
+_(0xb7, chrgot)
+
+// usraddr
+_(0x03f8, ommvec)
+_(0x057b, ch80)
+
+_(0xbe6c, vpath1)
+_(0xbe6e, vpath2)
+
+_(0xc000, kbd)
+_(0xc010, strb)
+_(0xc019, rdvblbar)
+_(0xc036, cyareg)
+_(0xc061, cmdkey)
+
+
+_(0xd393, bltu)
+_(0xd3e3, reason)
+_(0xd412, error)
+_(0xd52c, inlin)
+_(0xd539, gdbufs)
+_(0xd553, inchr)
+_(0xd566, run)
+_(0xd61a, fndlin)
+_(0xd64b, scrtch)
+_(0xd66c, clearc)
+_(0xd683, stkini)
+_(0xd697, stxtpt)
+_(0xd7d2, newstt)
+_(0xd849, restor)
+_(0xd858, iscntc)
+_(0xd898, cont)
+_(0xd93e, goto)
+_(0xd995, data)
+_(0xd998, addon)
+_(0xd9a3, datan)
+_(0xd9a6, remn)
+_(0xda0c, linget)
+_(0xda46, let)
+_(0xda7b, getspt)
+_(0xdafb, crdo)
+_(0xdb3a, strout)
+_(0xdb3d, strprt)
+_(0xdb57, outspc)
+_(0xdb5a, outqst)
+_(0xdb5c, outdo)
+_(0xdd67, frmnum)
+_(0xdd6a, chknum)
+_(0xdd6c, chkstr)
+_(0xdd6d, chkval)
+_(0xdd7b, frmevl)
+_(0xde81, strtxt)
+_(0xdeb2, parchk)
+_(0xdeb8, chkcls)
+_(0xdebb, chkopn)
+_(0xdebe, chkcom)
+_(0xdec0, synchr)
+_(0xdfe3, ptrget)
+_(0xe07d, isletc)
+_(0xe10c, ayint)
+_(0xe2f2, givayf)
+_(0xe301, sngflt)
+_(0xe306, errdir)
+_(0xe3d5, strini)
+_(0xe3dd, strspa)
+_(0xe3e7, strlit)
+_(0xe3ed, strlt2)
+_(0xe42a, putnew)
+_(0xe452, getspa)
+_(0xe484, garbag)
+_(0xe5d4, movins)
+_(0xe5e2, movstr)
+_(0xe5fd, frestr)
+_(0xe6f8, getbyte)
+_(0xe752, getadr)
+_(0xed24, prdec)
+_(0xf941, prntax)
+_(0xfc10, bs)
+_(0xfc1a, up)
+_(0xfc66, lf)
+_(0xfd8e, crout)
+_(0xfdda, prbyte)
+_(0xfded, cout)
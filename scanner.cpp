@@ -0,0 +1,117 @@
+#include "scanner.h"
+#include "omm.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <thread>
+#include <cxx/vector.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// kind, res1, and res2 are always 0 so every header contains 6 consecutive
+// 0 bytes at offset 10.  The pre-filter looks for those, 16 offsets at a time,
+// before the full header check.
+
+static constexpr const size_t kZeroOffset = 10;
+static constexpr const size_t kBlockSize = 16;
+
+// 0 bytes in data[0..32) as a bitmask.
+static uint32_t zero_mask(const uint8_t *data) {
+#if defined(__SSE2__)
+	const __m128i zero = _mm_setzero_si128();
+	__m128i a = _mm_loadu_si128((const __m128i *)data);
+	__m128i b = _mm_loadu_si128((const __m128i *)(data + 16));
+	uint32_t lo = _mm_movemask_epi8(_mm_cmpeq_epi8(a, zero));
+	uint32_t hi = _mm_movemask_epi8(_mm_cmpeq_epi8(b, zero));
+	return lo | (hi << 16);
+#else
+	uint32_t mask = 0;
+	for (unsigned i = 0; i < 32; ++i) {
+		if (!data[i]) mask |= UINT32_C(1) << i;
+	}
+	return mask;
+#endif
+}
+
+
+void scanner::check(size_t offset, std::vector<size_t> &hits) const {
+	header h;
+	if (read_header(_data + offset, _size - offset, h, false))
+		hits.push_back(offset);
+}
+
+// check header offsets in [begin, end)
+void scanner::scan(size_t begin, size_t end, std::vector<size_t> &hits) const {
+
+	size_t offset = begin;
+
+	// 6 zeros starting at offset + 10 (32 bytes loaded per 16 offsets).
+	while (offset + kZeroOffset + 32 <= _size && offset + kBlockSize <= end) {
+		uint32_t m = zero_mask(_data + offset + kZeroOffset);
+		m &= m >> 1;
+		m &= m >> 2;
+		m &= m >> 2;
+		m &= 0xffff;
+
+		while (m) {
+			unsigned i = __builtin_ctz(m);
+			m &= m - 1;
+			check(offset + i, hits);
+		}
+		offset += kBlockSize;
+	}
+
+	for ( ; offset < end; ++offset) {
+		if (offset + 16 + 3 > _size) break;
+		check(offset, hits);
+	}
+}
+
+// modules don't nest so drop any hits inside an earlier module
+// (typically zero-filled data).
+std::vector<size_t> &scanner::nested(std::vector<size_t> &hits) const {
+
+	size_t next = 0;
+
+	erase_if(hits, [this, &next](size_t offset){
+		header h;
+		if (offset < next) return true;
+		read_header(_data + offset, _size - offset, h, false);
+		next = offset + 16 + h.size;
+		return false;
+	});
+	return hits;
+}
+
+std::vector<size_t> scanner::scan(unsigned threads) const {
+
+	std::vector<size_t> hits;
+
+	if (_size < 16 + 3) return hits;
+
+	// only bother with threads for multi-megabyte inputs.
+	if (!threads) threads = std::thread::hardware_concurrency();
+	threads = std::min<size_t>(threads, _size >> 20);
+
+	if (threads <= 1) {
+		scan(0, _size, hits);
+		return nested(hits);
+	}
+
+	size_t chunk = (_size / threads + kBlockSize - 1) & ~(kBlockSize - 1);
+
+	std::vector<std::vector<size_t>> results(threads);
+
+	parallel_for(threads, threads, [&](size_t i){
+		size_t begin = chunk * i;
+		size_t end = std::min(_size, begin + chunk);
+		if (begin < end) scan(begin, end, results[i]);
+	});
+
+	for (const auto &v : results)
+		hits.insert(hits.end(), v.begin(), v.end());
+
+	return nested(hits);
+}
@@ -0,0 +1,30 @@
+#ifndef __scanner_h__
+#define __scanner_h__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+// find embedded OMM modules in a larger blob (memory dumps, archives, etc)
+
+class scanner {
+
+public:
+
+	scanner(const uint8_t *data, size_t size) : _data(data), _size(size)
+	{}
+
+	// returns the (sorted) offset of every valid header.
+	std::vector<size_t> scan(unsigned threads = 0) const;
+
+private:
+
+	void scan(size_t begin, size_t end, std::vector<size_t> &hits) const;
+	void check(size_t offset, std::vector<size_t> &hits) const;
+	std::vector<size_t> &nested(std::vector<size_t> &hits) const;
+
+	const uint8_t *_data;
+	size_t _size;
+};
+
+#endif
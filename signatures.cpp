@@ -0,0 +1,206 @@
+#include "signatures.h"
+#include "omm.h"
+
+#include <err.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <algorithm>
+#include <deque>
+#include <functional>
+
+
+signature_set &signature_set::standard() {
+	static signature_set set;
+	return set;
+}
+
+
+bool signature_set::add(const std::string &name, const std::string &pattern) {
+
+	signature s;
+	s.name = name;
+
+	std::string tmp;
+	for (char c : pattern) {
+		if (!isspace(c)) tmp.push_back(c);
+	}
+	if (tmp.empty() || tmp.size() & 1) return false;
+
+	for (size_t i = 0; i < tmp.size(); i += 2) {
+		if (tmp[i] == '?' && tmp[i + 1] == '?') {
+			s.bytes.push_back(-1);
+			continue;
+		}
+		if (!isxdigit(tmp[i]) || !isxdigit(tmp[i + 1])) return false;
+		s.bytes.push_back(strtoul(tmp.substr(i, 2).c_str(), nullptr, 16));
+	}
+
+	// the longest fixed run anchors it.
+	s.anchor = 0;
+	s.anchor_length = 0;
+	for (unsigned i = 0; i < s.bytes.size(); ) {
+		if (s.bytes[i] < 0) { ++i; continue; }
+		unsigned j = i;
+		while (j < s.bytes.size() && s.bytes[j] >= 0) ++j;
+		if (j - i > s.anchor_length) {
+			s.anchor = i;
+			s.anchor_length = j - i;
+		}
+		i = j;
+	}
+	if (!s.anchor_length) return false;
+
+	_signatures.emplace_back(std::move(s));
+	return true;
+}
+
+
+int signature_set::child(unsigned state, uint8_t c) const {
+	const auto &next = _nodes[state].next;
+	auto iter = std::lower_bound(next.begin(), next.end(), std::make_pair(c, 0u));
+	if (iter == next.end() || iter->first != c) return -1;
+	return iter->second;
+}
+
+unsigned signature_set::step(unsigned state, uint8_t c) const {
+	for (;;) {
+		int x = child(state, c);
+		if (x >= 0) return x;
+		if (state == 0) return 0;
+		state = _nodes[state].fail;
+	}
+}
+
+
+void signature_set::build() {
+
+	_nodes.clear();
+	_nodes.emplace_back();
+
+	// trie of anchors.
+	for (unsigned i = 0; i < _signatures.size(); ++i) {
+		const auto &s = _signatures[i];
+		unsigned state = 0;
+		for (unsigned j = 0; j < s.anchor_length; ++j) {
+			uint8_t c = s.bytes[s.anchor + j];
+			int x = child(state, c);
+			if (x < 0) {
+				x = _nodes.size();
+				_nodes.emplace_back();
+				auto &next = _nodes[state].next;
+				next.insert(std::upper_bound(next.begin(), next.end(), std::make_pair(c, 0u)), std::make_pair(c, (unsigned)x));
+			}
+			state = x;
+		}
+		_nodes[state].output.push_back(i);
+	}
+
+	// fail and output links, breadth first.
+	std::deque<unsigned> queue;
+	for (const auto &e : _nodes[0].next) queue.push_back(e.second);
+
+	while (!queue.empty()) {
+		unsigned state = queue.front();
+		queue.pop_front();
+
+		for (const auto &e : _nodes[state].next) {
+			unsigned x = e.second;
+			unsigned f = _nodes[state].fail;
+			unsigned fx = step(f, e.first);
+			_nodes[x].fail = fx == x ? 0 : fx;
+			unsigned tmp = _nodes[x].fail;
+			_nodes[x].output_link = _nodes[tmp].output.empty() ? _nodes[tmp].output_link : tmp;
+			queue.push_back(x);
+		}
+	}
+}
+
+
+std::vector<std::pair<unsigned, std::string>> signature_set::match(const module &m) const {
+
+	std::vector<std::pair<unsigned, std::string>> rv;
+	if (_signatures.empty() || _nodes.empty()) return rv;
+
+	const auto &h = m.h;
+	const uint32_t size = m.end - m.begin;
+
+	// best (lowest) signature for each matched label.
+	std::vector<std::pair<unsigned, unsigned>> found;
+
+	auto verify = [&](const signature &s, uint32_t end) {
+		// end is the offset just past the anchor.
+		uint32_t anchor_end = s.anchor + s.anchor_length;
+		if (end < anchor_end) return;
+		uint32_t start = end - anchor_end;
+		if (size - start < s.bytes.size()) return;
+
+		for (unsigned i = 0; i < s.bytes.size(); ++i) {
+			if (s.bytes[i] >= 0 && m.begin[start + i] != s.bytes[i]) return;
+		}
+
+		uint32_t address = h.org + start;
+		if (address != h.org && !std::binary_search(m.labels.begin(), m.labels.end(), address, std::greater<unsigned>())) return;
+		found.emplace_back(address, &s - _signatures.data());
+	};
+
+	auto scan = [&](uint32_t begin, uint32_t end) {
+		unsigned state = 0;
+		for (uint32_t i = begin; i < end; ++i) {
+			state = step(state, m.begin[i]);
+			for (unsigned x = _nodes[state].output.empty() ? _nodes[state].output_link : state; x; x = _nodes[x].output_link) {
+				for (auto j : _nodes[x].output) verify(_signatures[j], i + 1);
+			}
+		}
+	};
+
+	scan(0, m.end_code - m.begin);
+	for (const auto &r : m.code_regions) scan(r.begin - h.org, r.end - h.org);
+
+	std::sort(found.begin(), found.end());
+	for (const auto &f : found) {
+		if (!rv.empty() && rv.back().first == f.first) continue;
+		rv.emplace_back(f.first, _signatures[f.second].name);
+	}
+	return rv;
+}
+
+
+bool load_signatures(const std::string &path, signature_set &signatures) {
+
+	FILE *fp = fopen(path.c_str(), "r");
+	if (!fp) {
+		warn("%s", path.c_str());
+		return false;
+	}
+
+	char *buffer = nullptr;
+	size_t capacity = 0;
+	unsigned line = 0;
+	bool ok = true;
+
+	while (getline(&buffer, &capacity, fp) > 0) {
+		++line;
+
+		char *cp = strchr(buffer, ';');
+		if (cp) *cp = 0;
+
+		cp = buffer + strspn(buffer, " \t\r\n");
+		if (!*cp) continue;
+
+		size_t n = strcspn(cp, " \t\r\n");
+		std::string name(cp, n);
+		std::string pattern(cp + n);
+
+		if (!signatures.add(name, pattern)) {
+			warnx("%s:%u: bad pattern for %s", path.c_str(), line, name.c_str());
+			ok = false;
+		}
+	}
+
+	free(buffer);
+	fclose(fp);
+	signatures.build();
+	return ok;
+}
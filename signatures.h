@@ -0,0 +1,65 @@
+#ifndef __signatures_h__
+#define __signatures_h__
+
+#include <stdint.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct module;
+
+// byte patterns for known routines (print loops, getbyte/chkcom
+// wrappers, omm glue, ...) with wildcard operand bytes.  The longest
+// fixed run of each pattern goes into one Aho-Corasick automaton, so a
+// module is scanned once no matter how many signatures there are;
+// anchor hits are then checked against the whole pattern.
+
+class signature_set {
+
+public:
+
+	// hex bytes, ?? for any byte.  eg, "a0 00 b1 ?? f0 ?? 20 ed fd".
+	bool add(const std::string &name, const std::string &pattern);
+
+	bool empty() const { return _signatures.empty(); }
+
+	// the automaton.  Call after the last add, before matching.
+	void build();
+
+	// (address, name) of routines (labels) that match, sorted by
+	// address.  The first signature added wins.
+	std::vector<std::pair<unsigned, std::string>> match(const module &m) const;
+
+	// anything from signature files.
+	static signature_set &standard();
+
+private:
+
+	struct signature {
+		std::string name;
+		std::vector<int16_t> bytes; // -1 = any
+		unsigned anchor; // offset of the fixed run in the automaton
+		unsigned anchor_length;
+	};
+
+	struct node {
+		std::vector<std::pair<uint8_t, unsigned>> next; // sorted
+		unsigned fail = 0;
+		// next node (via fail links) with output, or 0.
+		unsigned output_link = 0;
+		std::vector<unsigned> output; // signatures anchored here
+	};
+
+	unsigned step(unsigned state, uint8_t c) const;
+	int child(unsigned state, uint8_t c) const;
+
+	std::vector<signature> _signatures;
+	std::vector<node> _nodes;
+};
+
+// signature file (builds the automaton):
+// ; comment
+// name    pattern
+bool load_signatures(const std::string &path, signature_set &signatures);
+
+#endif
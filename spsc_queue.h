@@ -0,0 +1,123 @@
+#ifndef __spsc_queue_h__
+#define __spsc_queue_h__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// bounded lock-free queue between exactly one producer thread and one
+// consumer thread.  push/pop spin (yielding) when full/empty and the
+// time spent waiting is recorded for each side.
+
+template<class T>
+class spsc_queue {
+
+public:
+
+	struct stats {
+		size_t items = 0;
+		size_t max_depth = 0;
+		uint64_t total_depth = 0; // sampled at each push
+		std::chrono::nanoseconds push_stall{0}; // producer waiting on a full queue
+		std::chrono::nanoseconds pop_stall{0}; // consumer waiting on an empty queue
+	};
+
+	// capacity is rounded up to a power of 2.
+	explicit spsc_queue(size_t capacity) {
+		size_t n = 1;
+		while (n < capacity) n <<= 1;
+		_slots.resize(n);
+		_mask = n - 1;
+	}
+
+	spsc_queue(const spsc_queue &) = delete;
+	spsc_queue &operator=(const spsc_queue &) = delete;
+
+	bool try_push(T &value) {
+		size_t head = _head.load(std::memory_order_relaxed);
+		if (head - _tail_cache == _slots.size()) {
+			_tail_cache = _tail.load(std::memory_order_acquire);
+			if (head - _tail_cache == _slots.size()) return false;
+		}
+		_slots[head & _mask] = std::move(value);
+		_head.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+	bool try_pop(T &value) {
+		size_t tail = _tail.load(std::memory_order_relaxed);
+		if (tail == _head_cache) {
+			_head_cache = _head.load(std::memory_order_acquire);
+			if (tail == _head_cache) return false;
+		}
+		value = std::move(_slots[tail & _mask]);
+		_tail.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+	void push(T value) {
+		if (!try_push(value)) {
+			auto start = std::chrono::steady_clock::now();
+			while (!try_push(value)) std::this_thread::yield();
+			_stats.push_stall += std::chrono::steady_clock::now() - start;
+		}
+
+		size_t depth = _head.load(std::memory_order_relaxed) - _tail.load(std::memory_order_relaxed);
+		++_stats.items;
+		_stats.total_depth += depth;
+		if (depth > _stats.max_depth) _stats.max_depth = depth;
+	}
+
+	// false once the producer has closed the queue and it's empty.
+	bool pop(T &value) {
+		if (try_pop(value)) return true;
+
+		auto start = std::chrono::steady_clock::now();
+		bool ok = false;
+		for (;;) {
+			if (try_pop(value)) { ok = true; break; }
+			if (_closed.load(std::memory_order_acquire)) {
+				// anything pushed before the close.
+				ok = try_pop(value);
+				break;
+			}
+			std::this_thread::yield();
+		}
+		_pop_stall += std::chrono::steady_clock::now() - start;
+		return ok;
+	}
+
+	void close() { _closed.store(true, std::memory_order_release); }
+
+	size_t capacity() const { return _slots.size(); }
+
+	// only meaningful once both threads are done.
+	stats statistics() const {
+		stats tmp = _stats;
+		tmp.pop_stall = _pop_stall;
+		return tmp;
+	}
+
+private:
+
+	std::vector<T> _slots;
+	size_t _mask = 0;
+
+	// producer side.
+	alignas(64) std::atomic<size_t> _head{0};
+	size_t _tail_cache = 0;
+	stats _stats;
+
+	// consumer side.
+	alignas(64) std::atomic<size_t> _tail{0};
+	size_t _head_cache = 0;
+	std::chrono::nanoseconds _pop_stall{0};
+
+	alignas(64) std::atomic<bool> _closed{false};
+};
+
+#endif
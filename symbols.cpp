@@ -0,0 +1,252 @@
+#include "symbols.h"
+#include "disassembler.h"
+#include "parallel.h"
+
+#include <stdio.h>
+#include <ctype.h>
+#include <err.h>
+
+#include <algorithm>
+
+
+static const char *token_text[] = {
+#undef _
+#define _(a,b,c) c,
+#include "applesoft_tokens.h"
+#undef _
+};
+
+
+std::string symbol_index::id_string(uint16_t id) {
+
+	if (isprint(id & 0xff) && isprint(id >> 8)) {
+		std::string tmp;
+		tmp.push_back('\'');
+		tmp.push_back(id & 0xff);
+		tmp.push_back(id >> 8);
+		tmp.push_back('\'');
+		return tmp;
+	}
+	return disassembler::to_x(id, 4, '$');
+}
+
+
+// usually token, 0 or 'text', 0
+// but could include:
+// ON 'HANGUP' GOTO
+std::vector<symbol_index::symbol> symbol_index::ampersand_keywords(const module &m) {
+
+	std::vector<symbol> rv;
+
+	if (!m.h.amperct) return rv;
+
+	uint32_t pc = m.h.amperct;
+	uint32_t start = pc;
+	std::string tmp;
+	bool text = false;
+
+	le_cursor cursor(m.begin + (pc - m.h.org), m.end);
+	for (uint8_t c; cursor.read(c); ++pc) {
+
+		if (c == 0x00 || c == 0xff) {
+			if (!tmp.empty())
+				rv.push_back(symbol{ symbol::ampersand, tmp, start });
+			tmp.clear();
+			text = false;
+			start = pc + 1;
+			if (c == 0xff) break;
+			continue;
+		}
+
+		if (isascii(c) && isprint(c)) {
+			if (!tmp.empty() && !text) tmp.push_back(' ');
+			tmp.push_back(toupper(c));
+			text = true;
+			continue;
+		}
+
+		if (c >= 0x80 && c <= 0xea) {
+			if (!tmp.empty()) tmp.push_back(' ');
+			tmp += token_text[c - 0x80];
+			text = false;
+		}
+	}
+
+	return rv;
+}
+
+
+// lda #<id / sta a1 / lda #>id / sta a1+1 / jsr ommvec
+std::vector<symbol_index::reference> symbol_index::find_references(const module &m) {
+
+	std::vector<reference> rv;
+
+	int a = -1, x = -1, y = -1;
+	int lo = -1, hi = -1;
+
+	uint32_t pc = m.h.org;
+	auto iter = m.begin;
+
+	while (iter < m.end_code) {
+		uint8_t op = *iter;
+		unsigned size = disassembler::operand_size(op, false, false);
+
+		if (iter + 1 + size > m.end_code) break;
+
+		uint32_t arg = 0;
+		for (unsigned i = 0; i < size; ++i)
+			arg |= iter[1 + i] << (i * 8);
+
+		switch(op) {
+			case 0xa9: a = arg; break; // lda #
+			case 0xa2: x = arg; break; // ldx #
+			case 0xa0: y = arg; break; // ldy #
+
+			case 0x84: // sty <dp
+			case 0x85: // sta <dp
+			case 0x86: // stx <dp
+			{
+				int value = op == 0x85 ? a : op == 0x86 ? x : y;
+				if (arg == 0x3c) lo = value;
+				if (arg == 0x3d) hi = value;
+				break;
+			}
+
+			// stores don't change registers.
+			case 0x81: case 0x8c: case 0x8d: case 0x8e:
+			case 0x91: case 0x92: case 0x94: case 0x95:
+			case 0x96: case 0x99: case 0x9d:
+				break;
+
+			case 0x20: // jsr
+			case 0x4c: // jmp
+				if (arg == 0x03f8 && lo >= 0 && hi >= 0) // ommvec
+					rv.push_back(reference{ pc, (uint16_t)(lo | (hi << 8)), -1 });
+				// skip any inline parameters.
+				if (op == 0x20)
+					size += inline_params::standard().length(arg, iter + 1 + size, m.end_code);
+				// fallthrough
+			case 0x60: // rts
+				lo = hi = -1;
+				// fallthrough
+			default:
+				a = x = y = -1;
+				break;
+		}
+
+		iter += 1 + size;
+		pc += 1 + size;
+	}
+
+	return rv;
+}
+
+
+unsigned symbol_index::add(const std::string &name, const header &h, const uint8_t *data) {
+	entry e;
+	e.name = name;
+	e.h = h;
+	e.data = data;
+	_modules.emplace_back(std::move(e));
+	return _modules.size() - 1;
+}
+
+
+void symbol_index::build(unsigned threads) {
+
+	// modules are independent.
+	parallel_for(_modules.size(), threads, [this](size_t i){
+		auto &e = _modules[i];
+
+		analyze(e.m, e.h, e.data);
+
+		e.exports.push_back(symbol{ symbol::entry, "start", e.h.org });
+		for (auto &s : ampersand_keywords(e.m))
+			e.exports.emplace_back(std::move(s));
+
+		e.references = find_references(e.m);
+	});
+
+	_ids.clear();
+	_keywords.clear();
+
+	for (unsigned i = 0; i < _modules.size(); ++i) {
+		const auto &e = _modules[i];
+
+		_ids.emplace(e.h.id, i);
+		for (const auto &s : e.exports) {
+			if (s.kind == symbol::ampersand)
+				_keywords[s.name].push_back(i);
+		}
+	}
+}
+
+
+int symbol_index::find_module(uint16_t id) const {
+	auto iter = _ids.find(id);
+	if (iter == _ids.end()) return -1;
+	return iter->second;
+}
+
+
+void symbol_index::resolve(unsigned threads) {
+
+	parallel_for(_modules.size(), threads, [this](size_t i){
+		for (auto &r : _modules[i].references)
+			r.target = find_module(r.id);
+	});
+}
+
+
+void symbol_index::report() const {
+
+	puts("*------------------------------*");
+	puts("*           Modules            *");
+	puts("*------------------------------*");
+	puts("");
+
+	for (const auto &e : _modules) {
+		printf("%-6s  org $%04x  size $%04x  %s\n",
+			id_string(e.h.id).c_str(), e.h.org, e.h.size, e.name.c_str());
+
+		for (const auto &s : e.exports) {
+			printf("        $%04x  %s %s\n", s.address,
+				s.kind == symbol::entry ? "entry" : "&",
+				s.name.c_str());
+		}
+
+		if (_ids.count(e.h.id) > 1)
+			warnx("%s: duplicate module id %s", e.name.c_str(), id_string(e.h.id).c_str());
+	}
+
+	puts("");
+	puts("*------------------------------*");
+	puts("*          References          *");
+	puts("*------------------------------*");
+	puts("");
+
+	for (const auto &e : _modules) {
+		for (const auto &r : e.references) {
+			printf("%s: $%04x -> %-6s  %s\n", e.name.c_str(), r.address,
+				id_string(r.id).c_str(),
+				r.target >= 0 ? _modules[r.target].name.c_str() : "(unresolved)");
+		}
+	}
+
+	std::vector<const std::string *> names;
+	for (const auto &kv : _keywords) {
+		if (kv.second.size() > 1) names.push_back(&kv.first);
+	}
+	std::sort(names.begin(), names.end(), [](const std::string *a, const std::string *b){
+		return *a < *b;
+	});
+
+	for (auto name : names) {
+		std::string tmp;
+		for (auto i : _keywords.find(*name)->second) {
+			if (!tmp.empty()) tmp += ", ";
+			tmp += _modules[i].name;
+		}
+		warnx("& %s defined in %s", name->c_str(), tmp.c_str());
+	}
+}
@@ -0,0 +1,72 @@
+#ifndef __symbols_h__
+#define __symbols_h__
+
+#include "omm.h"
+
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// global symbol space for a set of OMM modules loaded together.
+// modules find each other by id (in a1) via ommvec, so references are
+// resolved by id.  Once built, the tables are read-only and shared by
+// all worker threads.
+
+class symbol_index {
+
+public:
+
+	struct symbol {
+		enum { entry, ampersand } kind;
+		std::string name;
+		uint32_t address;
+	};
+
+	// module id stored to a1/a1+1 before a call
+	struct reference {
+		uint32_t address;
+		uint16_t id;
+		int target;
+	};
+
+	struct entry {
+		std::string name;
+		header h;
+		const uint8_t *data;
+
+		module m;
+		std::vector<symbol> exports;
+		std::vector<reference> references;
+	};
+
+	// data points to the header and must outlive the index.
+	unsigned add(const std::string &name, const header &h, const uint8_t *data);
+
+	// analyze every module then build the global tables.
+	void build(unsigned threads = 0);
+
+	// resolve inter-module references against the global tables.
+	void resolve(unsigned threads = 0);
+
+	void report() const;
+
+	const std::vector<entry> &modules() const { return _modules; }
+
+	// -1 if not found.
+	int find_module(uint16_t id) const;
+
+	static std::string id_string(uint16_t id);
+	static std::vector<symbol> ampersand_keywords(const module &m);
+
+private:
+
+	static std::vector<reference> find_references(const module &m);
+
+	std::vector<entry> _modules;
+
+	std::unordered_multimap<uint16_t, unsigned> _ids;
+	std::unordered_map<std::string, std::vector<unsigned>> _keywords;
+};
+
+#endif
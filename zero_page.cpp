@@ -0,0 +1,49 @@
+#include "zero_page.h"
+#include "parallel.h"
+
+#include <utility>
+
+
+unsigned zp_index::add(const std::string &name, const header &h, const uint8_t *data) {
+	entry e;
+	e.name = name;
+	e.h = h;
+	e.data = data;
+	_modules.emplace_back(std::move(e));
+	return _modules.size() - 1;
+}
+
+
+void zp_index::build(unsigned flags, unsigned threads) {
+
+	parallel_for(_modules.size(), threads, [this, flags](size_t i){
+		auto &e = _modules[i];
+		module m;
+
+		analyze(m, e.h, e.data, flags);
+		e.reads = m.zp_reads;
+		e.writes = m.zp_writes;
+	});
+}
+
+
+std::vector<zp_index::conflict> zp_index::conflicts(unsigned threads) const {
+
+	// one row per module so the result is in order without a sort.
+	std::vector<std::vector<conflict>> rows(_modules.size());
+
+	parallel_for(_modules.size(), threads, [&](size_t i){
+		const auto &a = _modules[i];
+		const auto used = a.reads | a.writes;
+
+		for (size_t j = i + 1; j < _modules.size(); ++j) {
+			const auto &b = _modules[j];
+			auto bytes = (a.writes & (b.reads | b.writes)) | (b.writes & used);
+			if (bytes.any()) rows[i].push_back(conflict{ (unsigned)i, (unsigned)j, bytes });
+		}
+	});
+
+	std::vector<conflict> rv;
+	for (auto &r : rows) rv.insert(rv.end(), r.begin(), r.end());
+	return rv;
+}
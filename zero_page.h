@@ -0,0 +1,50 @@
+#ifndef __zero_page_h__
+#define __zero_page_h__
+
+#include "omm.h"
+
+#include <stdint.h>
+#include <bitset>
+#include <string>
+#include <vector>
+
+// zero page footprints for a set of OMM modules.  Modules share zero
+// page with applesoft and each other, so a byte one module writes and
+// another reads or writes is a conflict.
+
+class zp_index {
+
+public:
+
+	struct entry {
+		std::string name;
+		header h;
+		const uint8_t *data;
+
+		std::bitset<256> reads;
+		std::bitset<256> writes;
+	};
+
+	struct conflict {
+		unsigned a;
+		unsigned b;
+		std::bitset<256> bytes;
+	};
+
+	// data points to the header and must outlive the index.
+	unsigned add(const std::string &name, const header &h, const uint8_t *data);
+
+	// analyze every module.
+	void build(unsigned flags = 0, unsigned threads = 0);
+
+	// every conflicting pair, a < b, sorted.
+	std::vector<conflict> conflicts(unsigned threads = 0) const;
+
+	const std::vector<entry> &modules() const { return _modules; }
+
+private:
+
+	std::vector<entry> _modules;
+};
+
+#endif